@@ -2,6 +2,7 @@
 #define __RAY_TRACE_H__
 
 #include <string>
+#include <vector>
 
 //Declare the Camera and World as classes.
 //This will eliminate the need for any explicit header files here.
@@ -20,6 +21,22 @@ typedef enum{
     PART_MODE_DYNAMIC = 32
 } PartType;
 
+//Specify the tone reproduction operators that can be applied to the
+//rendered floats before they are saved.
+typedef enum{
+    TONE_MODE_NONE = 0,
+    TONE_MODE_REINHARD = 1,
+    TONE_MODE_WARD = 2
+} ToneType;
+
+//Specify the orders in which the dynamic scheduler hands out blocks.
+typedef enum{
+    BLOCK_ORDER_ROWS = 0,
+    BLOCK_ORDER_MORTON = 1,
+    BLOCK_ORDER_HILBERT = 2,
+    BLOCK_ORDER_COST = 3
+} BlockOrderType;
+
 //Define a structure that will be used to hold all of the configuration data.
 typedef struct
 {
@@ -43,6 +60,73 @@ typedef struct
     World* world;
     std::string sceneID;
 
+    //Extended options parsed by parseOptions() before initialize().
+    //These are kept after the scene data so that the layout used by
+    //the ray tracing library is unchanged.
+    ToneType toneMode;
+    float toneKey;
+    float toneWorldLuminance;
+    float toneDisplayLuminance;
+
+    //Batch rendering along a camera path. frameIndex is -1 for a
+    //single image.
+    std::string cameraPath;
+    int numFrames;
+    int frameIndex;
+
+    //Render server mode.
+    std::string serverSocket;
+    int sceneCacheSize;
+
+    //Per-rank profiling: event tracing and hardware counters. fpEvent is
+    //a raw perf event for floating point operations, or 0 for none.
+    bool trace;
+    bool counters;
+    unsigned long long fpEvent;
+
+    //Autotuning of the block and cycle sizes.
+    bool autotune;
+    float tuneScale;
+    std::string tuneCache;
+
+    //Dynamic partitioning without a scheduling master, and node-aware
+    //gathering of the results.
+    bool dynamicRMA;
+    bool hierarchical;
+
+    //The order of the dynamic blocks, and for BLOCK_ORDER_COST the
+    //per-pixel cost map it is sorted by.
+    BlockOrderType blockOrder;
+    std::string costMapFile;
+    std::vector<float> costMap;
+    int costMapWidth;
+    int costMapHeight;
+
+    //Checkpointing of dynamic renders. checkpointInterval is the time
+    //in seconds between writes.
+    std::string checkpointFile;
+    float checkpointInterval;
+    bool resume;
+
+    //Rendering within a time budget in milliseconds (0 for none), with
+    //refinement by refineSamples x refineSamples supersampling.
+    float timeBudget;
+    int refineSamples;
+
+    //Pinning of the ranks to cores on NUMA nodes.
+    bool numa;
+
+    //The on-disk tile cache and its size cap in MB.
+    std::string tileCacheDir;
+    int tileCacheSize;
+
+    //Simplified meshes: the error bound in pixels (0 for none), the grid
+    //of the level forced on every model (0 for none) and the directory
+    //the levels are kept in.
+    float lodError;
+    int lodLevel;
+    std::string lodCacheDir;
+
 } ConfigData;
 
 //This function will do all of the command line argument parsing along with
@@ -0,0 +1,50 @@
+#ifndef __BUDGET_H__
+#define __BUDGET_H__
+
+#include "RayTrace.h"
+
+//This function prepares a render with a time budget (-timebudget). A
+//second copy of the scene is loaded with its camera set to supersample
+//with -refinesamples by -refinesamples rays per pixel, and -c is pointed
+//at a copy with one ray per pixel for the previews. It must be called
+//before initialize(), while the scene arguments are still intact, and does
+//nothing without -timebudget.
+//
+//Inputs:
+//    data - the ConfigData with the parsed extended options.
+//    argc - the number of input arguments.
+//    argv - the input arguments; the value of -c is replaced.
+//
+//Outputs:
+//    true if there was an error in the processing; otherwise, false
+bool budgetOpen(const ConfigData* data, int argc, char* argv[]);
+
+//This function checks that the render can run with a time budget. The
+//budget builds on the scheduling master of -p dynamic. It must be called
+//after initialize(), and removes the preview scene.
+//
+//Outputs:
+//    true if there was an error in the processing; otherwise, false
+bool budgetCheck(const ConfigData* data);
+
+//This function shuts down the refinement scene.
+void budgetClose();
+
+//These functions render the image within the time budget. Every block is
+//rendered at preview quality first; no preview is handed out after the
+//deadline, and the blocks left without one are reported, stay black and
+//are left out of the tone mapping average. The blocks are then refined
+//with the supersampled scene, most promising first (the preview cost of
+//the block times the spread of its luminance), as long as the refinement
+//is expected to finish before the deadline. A block still being refined
+//at the deadline is dropped and keeps its preview.
+//
+//Inputs:
+//    data - the ConfigData that holds the scene information.
+//    pixels - the image (master only).
+//
+//Outputs: None
+void masterBudgetPartition(ConfigData* data, float* pixels);
+void slaveBudgetPartition(ConfigData* data);
+
+#endif
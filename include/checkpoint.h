@@ -0,0 +1,56 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <vector>
+#include "RayTrace.h"
+#include "utils.h"
+
+//This function checks that the render can be checkpointed (-checkpoint).
+//Only -p dynamic with the scheduling master hands out blocks that the
+//master receives one at a time. It also hashes the -c scene file, which
+//the checkpoint is tied to.
+//
+//Inputs:
+//    data - the ConfigData that holds the scene information.
+//    argc - the number of input arguments.
+//    argv - the input arguments.
+//
+//Outputs:
+//    true if there was an error in the processing; otherwise, false
+bool checkpointCheck(const ConfigData* data, int argc, char* argv[]);
+
+//This function opens the checkpoint of a dynamic render on the master.
+//The completed blocks go to <checkpoint>.tiles and the row-major indices
+//of the durable ones to <checkpoint>.manifest; both files are only
+//appended to. With -resume, the blocks named in the manifest are read back
+//into the image and left out of the schedule.
+//
+//Inputs:
+//    data - the ConfigData that holds the scene information.
+//    dynamicBlock - a DynamicBlock for the render.
+//    pixels - the image.
+//    partial - the log luminance sums, given the restored blocks.
+//
+//Outputs:
+//    schedule - the block IDs that still have to be rendered, in order.
+//    true if there was an error in the processing; otherwise, false
+bool checkpointOpen(const ConfigData* data, DynamicBlock* dynamicBlock, float* pixels, std::vector<int>* schedule, double* partial);
+
+//This function adds a completed block to the checkpoint. Blocks are
+//written out every -checkpointinterval seconds, and less often if the
+//writes would take more than CHECKPOINT_BUDGET of the render time. The
+//cap covers only these intermediate writes, not the final one.
+//
+//Inputs:
+//    dynamicBlock - the DynamicBlock updated for the block.
+//    packet - the packet that holds the block's pixels.
+//
+//Outputs: None
+void checkpointBlock(DynamicBlock* dynamicBlock, const float* packet);
+
+//This function writes the remaining blocks, closes the checkpoint and
+//reports the time of the intermediate writes (as a share of the render)
+//and of this final write separately.
+void checkpointClose();
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __COUNTERS_H__
+#define __COUNTERS_H__
+
+#include <string>
+#include "RayTrace.h"
+
+//Opt-in hardware performance counters enabled with -counters. Each rank
+//counts cycles, instructions, cache misses and branch misses of its own
+//thread with perf_event_open, plus floating point operations when a raw
+//event is given with -fpevent (the encoding is CPU specific). The counts
+//and wall time are attributed to whichever phase is active.
+//
+//Counters that cannot be opened (no PMU, perf_event_paranoid, containers)
+//are reported as n/a; the time, shaded pixels and pixels per second are
+//always reported.
+
+typedef enum {
+	COUNTER_PHASE_NONE = -1,
+	COUNTER_PHASE_LOAD = 0,
+	COUNTER_PHASE_COMPUTE,
+	COUNTER_PHASE_COMMUNICATE,
+	COUNTER_PHASE_SAVE,
+	COUNTER_PHASE_MAX
+} CounterPhase;
+
+//Opens the counters on this rank if -counters was given. This does not
+//use MPI, so it can be called before the scene is loaded.
+void countersOpen(ConfigData* data);
+
+//Ends the current phase and starts counting for phase. COUNTER_PHASE_NONE
+//stops attributing counts until the next phase starts.
+void countersPhase(CounterPhase phase);
+
+//Gathers the counts of every rank on rank 0, prints the totals per phase,
+//pixels per second and instructions per pixel, and writes the per-rank
+//counts to <image>_counters.csv. pixels is the number of pixels this rank
+//shaded; with supersampling, every pixel traces several primary rays.
+//Every rank must call this; file is only used on rank 0.
+void countersReport(ConfigData* data, const std::string& file, long long pixels);
+
+#endif
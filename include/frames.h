@@ -0,0 +1,66 @@
+#ifndef __FRAMES_H__
+#define __FRAMES_H__
+
+#include <string>
+#include <vector>
+#include "RayTrace.h"
+
+//The camera parameters of a single frame. These replace the points and
+//vector that the <Camera> element of the scene refers to.
+typedef struct CameraFrame {
+	float eye[3];
+	float lookAt[3];
+	float up[3];
+} CameraFrame;
+
+typedef struct FrameSet {
+	std::vector<CameraFrame> cameras;
+	//The arguments given to initialize() for every frame, with the
+	//scene file at args[configArg].
+	std::vector<std::string> args;
+	int configArg;
+	std::string config;
+	int size() const { return (int)cameras.size(); }
+} FrameSet;
+
+//This function reads the camera path named by -path and expands its
+//keyframes into data->numFrames frames by linear interpolation; the up
+//vector is normalized again afterwards. Each line of the file holds one
+//keyframe as nine numbers: the eye point, the look at point and the up
+//vector. Blank lines and lines starting with # are ignored. The remaining
+//command line arguments are kept so that every frame can be initialized
+//in the same way as the first one.
+//
+//Outputs:
+//    true if there was an error in the processing; otherwise, false
+bool readCameraPath(const ConfigData* data, int argc, char* argv[], FrameSet* frames);
+
+//This function initializes the scene in data for the given frame. The
+//scene file is rewritten with the frame's camera and passed to
+//initialize(); a frame of -1 uses the scene file unchanged. The MPI
+//values in data are preserved.
+//
+//Outputs:
+//    true if there was an error in the processing; otherwise, false
+bool initializeFrame(ConfigData* data, const FrameSet* frames, int frame);
+
+//This function shuts down the scene held in data and initializes the
+//one for the given frame in its place. The scene is not kept resident
+//between frames: initialize() transforms every model into the space of
+//the camera it read, and the library has no way to move the camera of a
+//loaded scene, so each frame parses the scene and its models again. The
+//time this takes is added up for reportFrameLoads().
+//
+//Outputs:
+//    true if there was an error in the processing; otherwise, false
+bool loadFrame(ConfigData* data, const FrameSet* frames, int frame);
+
+//This function prints on rank 0 how often the ranks reloaded the scene
+//with loadFrame() and how long a reload took on average, and resets the
+//totals. Every rank must call this.
+void reportFrameLoads(const ConfigData* data);
+
+//Adds the frame number to an image file name when rendering a batch.
+std::string frameFileName(const ConfigData* data, std::string file);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef __GATHER_H__
+#define __GATHER_H__
+
+#include <vector>
+#include "RayTrace.h"
+
+//The rectangles of the image that one rank rendered, packed into a single
+//buffer of floats so that MPI counts are in elements rather than bytes:
+//for every region four ints (row, column, rows, columns), stored bit for
+//bit in four floats, followed by its RGB floats in row-major order.
+typedef struct PackedRegions {
+	std::vector<float> values;
+	void add(int rowStart, int colStart, int rows, int cols, const float* pixels);
+} PackedRegions;
+
+//This function collects the regions of every rank into rank 0's image
+//with node-aware aggregation (-hier). MPI_COMM_WORLD is split into one
+//communicator per shared-memory node; every node leader gathers and packs
+//the regions of its node and forwards them as one message to rank 0 over
+//a communicator of the leaders. Every rank must call this.
+//
+//Inputs:
+//    data - the ConfigData that holds the scene information.
+//    regions - the regions rendered by this rank; NULL if there are none
+//        (rank 0 renders straight into its image).
+//    pixels - the image on rank 0; NULL on the other ranks.
+//    computationTime - this rank's computation time. On rank 0 it is
+//        replaced by the largest one of all ranks.
+//
+//Outputs: None
+void gatherRegions(const ConfigData* data, const PackedRegions* regions, float* pixels, double* computationTime);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef __LOD_H__
+#define __LOD_H__
+
+#include "RayTrace.h"
+
+//This function swaps small meshes for simplified ones (-lod). Every
+//<Model> file of the scene is simplified into a pyramid of levels by
+//quadric error vertex clustering on grids of 4^3 to 1024^3 cells, and the
+//levels are kept in -lodcache, keyed by the contents of the model and its
+//material libraries. The coarsest level whose worst case error, projected
+//at the nearest point of the model's bounding sphere with the camera's
+//FrameWidth and FocalDistance at -w x -h, stays within -lod pixels is
+//chosen for each model. With -path, the distance is taken from the
+//nearest eye point of all the frames. -lodlevel instead forces the level
+//of one grid on every model, so that the render time of each level can be
+//compared. The scene is rewritten to use them, and -c is pointed at the
+//rewritten scene in the cache. Rank 0 reports every level and the one it
+//chose. It must be called before anything reads the scene, and does
+//nothing without -lod or -lodlevel.
+//
+//Inputs:
+//    data - the ConfigData with the parsed extended options.
+//    argc - the number of input arguments.
+//    argv - the input arguments; the value of -c is replaced.
+//
+//Outputs:
+//    true if there was an error in the processing; otherwise, false
+bool lodArguments(const ConfigData* data, int argc, char* argv[]);
+
+#endif
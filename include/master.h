@@ -2,6 +2,7 @@
 #define __MASTER_PROCESS_H__
 
 #include "RayTrace.h"
+#include "frames.h"
 
 //This function is the main that only the master process
 //will run.
@@ -9,8 +10,19 @@
 //Inputs:
 //    data - the ConfigData that holds the scene information.
 //
+//Outputs:
+//    the name of the file the image was saved to.
+std::string masterMain( ConfigData *data );
+
+//This function renders every frame of a camera path and saves one
+//image per frame.
+//
+//Inputs:
+//    data - the ConfigData that holds the scene information.
+//    frames - the frames read from the camera path.
+//
 //Outputs: None
-void masterMain( ConfigData *data );
+void masterFrames( ConfigData *data, const FrameSet *frames );
 
 //This function will perform ray tracing when no MPI use was
 //given.
@@ -26,4 +38,5 @@ void staticCyclesHorizontal(ConfigData *data, float* pixels);
 void masterStaticStripsVertical(ConfigData *data, float* pixels);
 void masterDynamicPartition(ConfigData *data, float* pixels);
 void masterStaticBlocks(ConfigData *data, float *pixels);
+void masterDynamicFrames(ConfigData *data, const FrameSet *frames);
 #endif
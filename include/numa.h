@@ -0,0 +1,30 @@
+#ifndef __NUMA_H__
+#define __NUMA_H__
+
+#include "RayTrace.h"
+
+//This function pins every rank to one core (-numa). The NUMA nodes and
+//their cores are read from /sys/devices/system/node, limited to the cores
+//this process may run on. The ranks on a machine are spread round-robin
+//over its nodes, so that memory bandwidth is shared evenly. It must be
+//called before the scene is loaded and the image is allocated, so that
+//every rank first-touches its own copy of the scene and its buffers on
+//its own node. Every rank must call this.
+//
+//Inputs:
+//    data - the ConfigData with the parsed extended options.
+//
+//Outputs: None
+void numaBind(const ConfigData* data);
+
+//This function reports, for every rank, the core and node it runs on and
+//how much of its resident memory is on its own node and how much on
+//others, from /proc/self/numa_maps. Every rank must call this.
+//
+//Inputs:
+//    data - the ConfigData that holds the scene information.
+//
+//Outputs: None
+void numaReport(const ConfigData* data);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef __OPTIONS_H__
+#define __OPTIONS_H__
+
+#include "RayTrace.h"
+
+//This function parses the options that are not understood by the ray
+//tracing library and removes them from the argument list, so that the
+//remaining arguments can be passed to initialize() unchanged. It must be
+//called before initialize(). All of the extended fields of the ConfigData
+//struct are given their default values here.
+//
+//Inputs:
+//    argc - The pointer to the number of input arguments
+//    argv - The pointer to the input arguments
+//    configuration - The pointer to the ConfigData struct that will be
+//        used to hold the relevant information.
+//
+//Outputs:
+//    true if there was an error in the processing; otherwise, false
+bool parseOptions(int* argc, char** argv[], ConfigData* configuration);
+
+//This function gives all of the extended fields of the ConfigData struct
+//their default values.
+void setDefaultOptions(ConfigData* configuration);
+
+//This function prints the usage of the options handled by parseOptions().
+void printOptionsHelp();
+
+#endif
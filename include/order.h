@@ -0,0 +1,35 @@
+#ifndef __ORDER_H__
+#define __ORDER_H__
+
+#include <vector>
+#include "RayTrace.h"
+
+//This function reads the per-pixel cost map given with -costmap (the
+//_cost.bin written by -trace) on rank 0 and broadcasts it, so that every
+//rank derives the same cost-sorted block order. It does nothing unless
+//-order cost was given. Every rank must call this.
+//
+//Inputs:
+//    data - the ConfigData that receives the cost map.
+//
+//Outputs:
+//    true if there was an error in the processing; otherwise, false
+bool loadCostMap(ConfigData* data);
+
+//This function computes the order in which the dynamic scheduler hands
+//out the blocks of a numBlocksWide by numBlocksTall grid (-order). The
+//Morton and Hilbert orders follow a space-filling curve, so blocks handed
+//out one after another lie next to each other in the image. The cost
+//order hands out the blocks with the largest cost in the cost map first.
+//
+//Inputs:
+//    data - the ConfigData that holds the scene information.
+//    blockWidth, blockHeight - the size of a block in pixels.
+//    numBlocksWide, numBlocksTall - the size of the block grid.
+//
+//Outputs:
+//    order - the row-major block index for each position in the schedule;
+//        left empty for the row-major order.
+void blockOrder(const ConfigData* data, int blockWidth, int blockHeight, int numBlocksWide, int numBlocksTall, std::vector<int>* order);
+
+#endif
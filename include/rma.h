@@ -0,0 +1,20 @@
+#ifndef __RMA_H__
+#define __RMA_H__
+
+#include "RayTrace.h"
+
+//This function renders the image with masterless dynamic partitioning
+//(-p dynamic with -rma). Every rank, including rank 0, claims the next
+//block ID with MPI_Fetch_and_op on a counter window held by rank 0 and
+//writes the finished block straight into rank 0's framebuffer window with
+//MPI_Put. No rank answers requests, so scheduling does not serialize on
+//rank 0.
+//
+//Inputs:
+//    data - the ConfigData that holds the scene information.
+//    pixels - the image on rank 0; NULL on the other ranks.
+//
+//Outputs: None
+void dynamicRMAPartition(ConfigData* data, float* pixels);
+
+#endif
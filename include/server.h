@@ -0,0 +1,33 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include "RayTrace.h"
+
+//This function runs the render server. Every rank calls it. Rank 0
+//listens on the UNIX socket given by -server and accepts one request per
+//connection. Each request is a single line of key=value pairs:
+//
+//    scene=<ConfigFile>    The config XML file that defines the scene
+//    width=<w> height=<h>  The size of the image
+//    mode=<PartitionType>  The partitioning scheme, as given to -p
+//    bh=<h> bw=<w> cs=<c>  The block and cycle sizes for that scheme
+//    camera=<9 values>     Optional eye point, look at point and up
+//                          vector, separated by commas
+//    reply=path|bytes      Whether to return the image path (default) or
+//                          the path followed by the image itself
+//
+//The line "quit" stops the server. The reply is "OK <file> <seconds>"
+//(with the image size in bytes and the image appended for reply=bytes)
+//or "ERROR <message>". Requests are broadcast to the other ranks, so the
+//worker pool and the most recently used scenes stay loaded between jobs.
+//A client that sends no complete line within CLIENT_TIMEOUT seconds is
+//dropped without a job, and one that goes away before its reply only
+//loses the reply.
+//
+//Inputs:
+//    data - the ConfigData holding the server options and MPI values.
+//
+//Outputs: None
+void serverMain(ConfigData* data);
+
+#endif
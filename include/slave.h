@@ -2,10 +2,13 @@
 #define __SLAVE_PROCESS_H__
 
 #include "RayTrace.h"
+#include "frames.h"
 
 void slaveMain( ConfigData *data );
+void slaveFrames( ConfigData *data, const FrameSet *frames );
 void staticCyclesHorizontal(ConfigData *data);
 void slaveStaticStripsVertical(ConfigData* data);
 void slaveStaticBlocks(ConfigData *data);
 void slaveDynamicPartition(ConfigData *data);
+void slaveDynamicFrames(ConfigData *data, const FrameSet *frames);
 #endif
@@ -0,0 +1,58 @@
+#ifndef __TILECACHE_H__
+#define __TILECACHE_H__
+
+#include <vector>
+#include "RayTrace.h"
+#include "utils.h"
+
+//This function hashes the scene for the tile cache (-tilecache): the
+//scene file, the models it loads and their material libraries. It must
+//be called before initialize(), while the scene arguments are still
+//intact, and does nothing without -tilecache or on ranks other than 0.
+//
+//Inputs:
+//    data - the ConfigData with the parsed extended options.
+//    argc - the number of input arguments.
+//    argv - the input arguments.
+//
+//Outputs:
+//    true if there was an error in the processing; otherwise, false
+bool tileCacheOpen(const ConfigData* data, int argc, char* argv[]);
+
+//This function checks that the render can use the tile cache. Only -p
+//dynamic with the scheduling master can leave blocks out.
+//
+//Outputs:
+//    true if there was an error in the processing; otherwise, false
+bool tileCacheCheck(const ConfigData* data);
+
+//This function copies the blocks found in the tile cache into the image
+//and removes them from the schedule. A block is stored under a hash of
+//the scene, the image size and its rectangle, so a block is found again
+//whatever the partitioning, as long as it covers the same pixels.
+//
+//Inputs:
+//    data - the ConfigData that holds the scene information.
+//    dynamicBlock - a DynamicBlock for the render.
+//    pixels - the image.
+//    schedule - the block IDs to render.
+//    partial - the log luminance sums, given the cached blocks.
+//
+//Outputs: None
+void tileCacheLookup(const ConfigData* data, DynamicBlock* dynamicBlock, float* pixels, std::vector<int>* schedule, double* partial);
+
+//This function stores a rendered block in the tile cache.
+//
+//Inputs:
+//    data - the ConfigData that holds the scene information.
+//    dynamicBlock - the DynamicBlock updated for the block.
+//    packet - the packet that holds the block's pixels.
+//
+//Outputs: None
+void tileCacheStore(const ConfigData* data, DynamicBlock* dynamicBlock, const float* packet);
+
+//This function evicts the least recently used blocks until the cache
+//fits in -tilecachesize and reports the hit rate.
+void tileCacheClose(const ConfigData* data);
+
+#endif
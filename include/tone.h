@@ -0,0 +1,33 @@
+#ifndef __TONE_H__
+#define __TONE_H__
+
+#include <mpi.h>
+#include "RayTrace.h"
+
+//Adds the log luminance of numPixels RGB pixels to a partial sum.
+//partial[0] holds the sum of log(delta + Lw) and partial[1] the number
+//of pixels, so partial sums from different regions can simply be added.
+void accumulateLogLuminance(const ConfigData* data, const float* pixels, int numPixels, double* partial);
+
+//Combines the partial sums of every rank in comm with MPI_Allreduce and
+//returns the log-average world luminance of the whole frame.
+double reduceLogAverageLuminance(double* partial, MPI_Comm comm);
+
+//Returns the log-average world luminance from a complete partial sum.
+double logAverageLuminance(const double* partial);
+
+//Applies the selected tone reproduction operator to numPixels RGB pixels
+//in place. Both operators are per channel, so the interleaved data is
+//processed four floats at a time.
+void toneMapPixels(const ConfigData* data, float* pixels, int numPixels, double logAverage);
+
+//Tone maps a full frame that is held by a single process.
+void toneMapFrame(const ConfigData* data, float* pixels);
+
+//Send and receive a packet of size floats. When tone reproduction is
+//enabled, the pixels are already in display range and are sent as 8-bit
+//values; packet[timeIdx] holds the computation time and is sent as a float.
+void sendPixelPacket(const ConfigData* data, float* packet, int size, int timeIdx, int dest, int tag);
+void recvPixelPacket(const ConfigData* data, float* packet, int size, int timeIdx, int source, int tag, MPI_Status* status);
+
+#endif
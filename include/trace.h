@@ -0,0 +1,48 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <string>
+#include "RayTrace.h"
+
+//Opt-in tracing enabled with -trace. Each rank records timestamped events
+//(tiles, sends, receives, barriers, reductions and the save) and the time
+//spent on every pixel it shades. When the render is finished, rank 0
+//writes the following next to the image:
+//
+//    <image>_trace.json  Chrome trace / Perfetto events, one track per rank
+//    <image>_tiles.csv   Every tile with its rank, size, primary rays and ns
+//    <image>_cost.png    A heat map of the time spent per pixel
+//    <image>_cost.bin    The raw per-pixel cost: int32 width, int32 height,
+//                        then width * height float32 nanoseconds, row-major
+//
+//All of the functions do nothing when tracing is disabled.
+
+//Starts tracing on every rank. This synchronizes the ranks so that the
+//timestamps of all ranks share an origin.
+void traceStart(ConfigData* data);
+
+//Gathers the events and pixel costs on rank 0 and writes the files above.
+//Every rank must call this; file is only used on rank 0.
+void traceFinish(ConfigData* data, const std::string& file);
+
+//Returns the current time to use as the start of an event.
+double traceNow();
+
+//Records an event on this rank that started at start and ends now.
+void traceEvent(const char* name, double start);
+
+//Records a tile that started at start and ends now.
+void traceTile(int rowStart, int colStart, int rows, int cols, double start);
+
+//Shades a pixel like shadePixel() and records how long it took.
+void shadeTracedPixel(float* color, int row, int column, ConfigData* data);
+
+//Returns the number of pixels this rank has shaded with shadeTracedPixel(),
+//whether or not tracing is enabled.
+long long shadedPixelCount();
+
+//Sets the number of shaded pixels back to zero, so renders that happened
+//before (such as the -autotune calibration) are not counted.
+void resetShadedPixelCount();
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __TUNE_H__
+#define __TUNE_H__
+
+#include "RayTrace.h"
+
+//This function fills in the block size (-bh/-bw) of dynamic partitioning
+//or the cycle size (-cs) of static_cycles_horizontal when they are left
+//out, using the tuning cache. Entries are keyed by a hash of the scene
+//file with its models and material libraries, the image size, the number
+//of processes, the mode, -rma, -hier and -order.
+//
+//With -autotune the parameters are searched for instead and stored in the
+//cache. The search renders the scene at low resolution with every
+//candidate, keeps the faster half and doubles the resolution until one
+//candidate is left (successive halving). Block and cycle sizes are scaled
+//with the resolution, so a candidate always splits the image into the same
+//number of pieces as it would at full size. Calibration renders use the
+//scheduler of the run (-rma, -hier, -order) and are not saved.
+//
+//Every rank calls this before initialize(); the arguments are extended in
+//place.
+//
+//Outputs:
+//    true if there was an error in the processing; otherwise, false
+bool tuneArguments(ConfigData* data, int* argc, char** argv[]);
+
+#endif
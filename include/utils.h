@@ -1,6 +1,7 @@
 #ifndef __UTILS_H__
 #define __UTILS_H__
 
+#include <vector>
 #include "RayTrace.h"
 
 typedef enum {
@@ -28,6 +29,8 @@ typedef struct DynamicBlock {
 	int blockHeight, blockWidth, blockRowStart, blockColStart, \
 		blockRowEnd, blockColEnd, blockRowNum, blockColNum, 
 		numBlocksWide, numBlocksTall, blockID, xBlockID, yBlockID;
+	//The row-major block for each block ID (-order); empty for rows.
+	std::vector<int> order;
 	
 	DynamicBlock(const ConfigData* data);
 
@@ -44,6 +47,13 @@ typedef struct DynamicBlock {
 	} DYNAMIC_PACKET;
 } DynamicBlock;
 
+//The master hands out the first block of every slave itself when it
+//leaves out blocks restored from a checkpoint or the tile cache;
+//otherwise every slave starts on block rank - 1.
+inline bool masterAssignsFirstBlock(const ConfigData* data) {
+	return data -> resume || !data -> tileCacheDir.empty();
+}
+
 int isPerfectSquare(int num);
 inline int ceilFunc(int m, int n) {
 	return (m + n - 1) / n;
@@ -0,0 +1,163 @@
+#!/bin/bash
+#
+# Benchmark driver for raytrace_mpi.
+#
+# Sweeps scenes, image sizes, partitioning modes and their parameters, and
+# process counts. Every configuration is repeated and the median and spread
+# (max - min) of the computation, communication, execution, load and save
+# times are written to CSV and JSON. Every image is checked against a
+# sequential reference render of the same scene and size with png_compare;
+# the script exits non-zero if any image has pixels that differ by more than
+# TOLERANCE (default 0) in some channel.
+#
+# Run it through "make bench", or directly. Every sweep can be overridden
+# from the environment, e.g.
+#   SIZES="500" PROCS="4 16" MODES="dynamic" BLOCKS="10x10 50x50" ./runner_bench.sh
+#
+# Inside a SLURM allocation the runs are started with srun; otherwise mpirun
+# is used. Set LAUNCH to use something else (the process count is appended).
+
+SCENES=${SCENES:-"configs/twhitted.xml configs/box.xml"}
+SIZES=${SIZES:-"250 500"}
+PROCS=${PROCS:-"4 9 16"}
+MODES=${MODES:-"static_strips_vertical static_cycles_horizontal static_blocks dynamic"}
+BLOCKS=${BLOCKS:-"10x10 25x25 50x50"}
+CYCLES=${CYCLES:-"1 10 50"}
+REPEATS=${REPEATS:-3}
+OUT=${OUT:-bench_results}
+BIN=${BIN:-./raytrace_mpi}
+COMPARE=${COMPARE:-./png_compare}
+TOLERANCE=${TOLERANCE:-0}
+
+if [ -z "$LAUNCH" ]; then
+    if [ -n "$SLURM_JOB_ID" ]; then
+        LAUNCH="srun -n"
+    else
+        LAUNCH="mpirun -np"
+    fi
+fi
+
+STAMP=$(date +%m%d%y-%H%M%S)
+mkdir -p "$OUT/references"
+CSV="$OUT/bench_$STAMP.csv"
+JSON="$OUT/bench_$STAMP.json"
+LOG="$OUT/bench_$STAMP.log"
+FAILURES=0
+
+echo "scene,width,height,mode,param,procs,repeats,compute_median,compute_spread,comm_median,comm_spread,exec_median,exec_spread,load_median,load_spread,save_median,save_spread,differing_pixels,status" > "$CSV"
+
+# Prints "median spread" for the numbers on stdin.
+stats() {
+    sort -g | awk '{ v[NR] = $1 } END {
+        if (NR == 0) { print "nan nan"; exit }
+        m = (NR % 2) ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2
+        print m, v[NR] - v[1] }'
+}
+
+# Pulls the value of one metric out of a run's output.
+metric() {
+    grep "^$2:" "$1" | head -1 | awk '{ print $(NF - 1) }'
+}
+
+# Compares an image against the reference and prints the pixels over the
+# tolerance, or -1 if the comparison could not be made.
+differing() {
+    local result
+    result=$($COMPARE -t "$TOLERANCE" "$1" "$2" 2>&1 | grep "Pixels over tolerance" | awk '{ print $NF }')
+    echo "${result:--1}"
+}
+
+# run <scene> <size> <mode> <param> <procs> <args...>
+run() {
+    local scene=$1 size=$2 mode=$3 param=$4 procs=$5
+    shift 5
+    local runs="$OUT/runs_$$"
+    local worst=0 status=ok
+    rm -f "$runs".*
+    for ((r = 0; r < REPEATS; r++)); do
+        local output="$OUT/run_$$.txt"
+        $LAUNCH "$procs" $BIN -w "$size" -h "$size" -c "$scene" -p "$mode" "$@" > "$output" 2>&1
+        cat "$output" >> "$LOG"
+        metric "$output" "Total Computation Time" >> "$runs.compute"
+        metric "$output" "Total Communication Time" >> "$runs.comm"
+        metric "$output" "Execution Time" >> "$runs.exec"
+        metric "$output" "Load Time" >> "$runs.load"
+        metric "$output" "Save Time" >> "$runs.save"
+        local image
+        image=$(grep "Image will be saved to:" "$output" | awk '{ print $NF }')
+        if [ "$mode" = "none" ]; then
+            [ -n "$image" ] && cp "$image" "$REFERENCE"
+        else
+            local diff
+            diff=$(differing "$REFERENCE" "$image")
+            if [ "$diff" != "0" ]; then
+                status=mismatch
+                # The largest count wins; -1 (no comparison) only replaces 0.
+                if [ "$diff" -gt "$worst" ] || [ "$worst" = 0 ]; then
+                    worst=$diff
+                fi
+            fi
+        fi
+        rm -f "$output"
+    done
+    [ "$status" = ok ] || FAILURES=$((FAILURES + 1))
+    local row="$scene,$size,$size,$mode,$param,$procs,$REPEATS"
+    for m in compute comm exec load save; do
+        row="$row,$(stats < "$runs.$m" | tr ' ' ',')"
+    done
+    echo "$row,$worst,$status" | tee -a "$CSV"
+    rm -f "$runs".*
+}
+
+is_square() {
+    local root
+    root=$(awk -v n="$1" 'BEGIN { r = int(sqrt(n) + 0.5); print (r * r == n) ? 1 : 0 }')
+    [ "$root" = 1 ]
+}
+
+for scene in $SCENES; do
+    for size in $SIZES; do
+        REFERENCE="$OUT/references/$(basename "$scene" .xml)_${size}.png"
+        run "$scene" "$size" none - 1
+        for mode in $MODES; do
+            for procs in $PROCS; do
+                case $mode in
+                    static_cycles_horizontal)
+                        for cs in $CYCLES; do
+                            run "$scene" "$size" "$mode" "$cs" "$procs" -cs "$cs"
+                        done
+                        ;;
+                    dynamic)
+                        for block in $BLOCKS; do
+                            run "$scene" "$size" "$mode" "$block" "$procs" -bh "${block%x*}" -bw "${block#*x}"
+                        done
+                        ;;
+                    static_blocks)
+                        is_square "$procs" && run "$scene" "$size" "$mode" - "$procs"
+                        ;;
+                    *)
+                        run "$scene" "$size" "$mode" - "$procs"
+                        ;;
+                esac
+            done
+        done
+    done
+done
+
+# Write the same table as JSON.
+awk -F, 'NR == 1 { for (i = 1; i <= NF; i++) key[i] = $i; printf "["; next }
+{
+    printf "%s\n  {", (NR > 2) ? "," : ""
+    for (i = 1; i <= NF; i++) {
+        numeric = ($i ~ /^-?[0-9.]+(e-?[0-9]+)?$/)
+        printf "%s\"%s\": %s%s%s", (i > 1) ? ", " : "", key[i], numeric ? "" : "\"", $i, numeric ? "" : "\""
+    }
+    printf "}"
+}
+END { print "\n]" }' "$CSV" > "$JSON"
+
+echo "Results: $CSV $JSON"
+if [ "$FAILURES" -ne 0 ]; then
+    echo "$FAILURES configuration(s) produced images that differ from the reference."
+    exit 1
+fi
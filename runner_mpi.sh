@@ -46,5 +46,40 @@
 # srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p static_cycles_horizontal -cs 650
 # Static Blocks
 # srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 100 -c configs/box.xml -p static_blocks 
+# Camera path batch (one image per frame in a single job; the scene is reloaded for every frame)
+# srun -n $SLURM_NPROCS raytrace_mpi -h 1000 -w 1000 -c configs/box.xml -p dynamic -bh 50 -bw 50 -path camera_path.txt -frames 120
+# Render server (send requests with e.g. socat - UNIX-CONNECT:/tmp/rt.sock)
+# srun -n $SLURM_NPROCS raytrace_mpi -server /tmp/rt.sock
+# Traced run (writes _trace.json for chrome://tracing or Perfetto, _tiles.csv and _cost.png/.bin)
+# srun -n $SLURM_NPROCS raytrace_mpi -h 1000 -w 1000 -c configs/box.xml -p dynamic -bh 50 -bw 50 -trace
+# Hardware counters per rank and phase (writes _counters.csv)
+# srun -n $SLURM_NPROCS raytrace_mpi -h 1000 -w 1000 -c configs/box.xml -p dynamic -bh 50 -bw 50 -counters
+# Autotune the block size once; later runs of the same scene, size and process count can leave -bh/-bw out
+# srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -autotune
+# Masterless dynamic: ranks claim blocks with MPI_Fetch_and_op and put them into rank 0's image
+# srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -bh 100 -bw 100 -rma
+# Node-aware gather: one leader per node forwards its node's pixels to rank 0
+# srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -bh 100 -bw 100 -hier
+# Dynamic blocks along a Hilbert curve, or most expensive first using the cost map of a -trace run
+# srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -bh 100 -bw 100 -order hilbert
+# srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -bh 100 -bw 100 -order cost -costmap renders/<image>_cost.bin
+# Checkpoint a long dynamic render every 5 minutes; rerun with -resume after a crash or time limit
+# srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -bh 100 -bw 100 -checkpoint box_5000 -checkpointinterval 300 -resume
+# Interactive preview: the best image that can be rendered in 500 ms
+# srun -n $SLURM_NPROCS raytrace_mpi -h 1000 -w 1000 -c configs/box.xml -p dynamic -bh 50 -bw 50 -timebudget 500 -refinesamples 3
+# Pin ranks to cores across the NUMA nodes and report remote memory
+# srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -bh 100 -bw 100 -numa
+# Reuse blocks of earlier identical renders from a shared tile cache capped at 4 GB
+# srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -bh 100 -bw 100 -tilecache tile_cache -tilecachesize 4096
+# Render small meshes with simplified levels accurate to half a pixel
+# srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -bh 100 -bw 100 -lod 0.5 -lodcache lod_cache
+# Compare the Load Time and render time of every level against the full meshes
+# srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -bh 100 -bw 100
+# for level in 4 8 16 32 64 128 256 512 1024; do
+#     srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -bh 100 -bw 100 -lodlevel $level -lodcache lod_cache
+# done
+# Record a per-pixel cost map once, then predict every mode and parameter offline
+# srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -bh 100 -bw 100 -trace
+# ./balance_sim -np 16,64,256 -latency 2 -bandwidth 10000 -csv predictions.csv renders/<image>_cost.bin
 # Dynamic
 srun -n $SLURM_NPROCS raytrace_mpi -h 5000 -w 5000 -c configs/box.xml -p dynamic -bh 100 -bw 100 
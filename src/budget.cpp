@@ -0,0 +1,368 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <queue>
+#include <vector>
+#include <unistd.h>
+#include <mpi.h>
+
+#include "budget.h"
+#include "utils.h"
+#include "master.h"
+#include "tone.h"
+#include "frames.h"
+#include "options.h"
+#include "trace.h"
+#include "counters.h"
+
+static ConfigData refineScene;
+static bool refineLoaded = false;
+static std::string previewPath;
+
+//Sets the supersampling of the <Camera> element, adding an
+//<AntiAliasing> element if it has none.
+static bool setSupersampling(std::string& xml, int samples) {
+	size_t camera = xml.find("<Camera ");
+	if (camera == std::string::npos) {
+		return false;
+	}
+	size_t cameraEnd = xml.find('>', camera);
+	if (cameraEnd == std::string::npos) {
+		return false;
+	}
+	std::ostringstream element;
+	element << "<AntiAliasing Method=\"Supersampling\" Size=\"" << samples << "\" />";
+	if (xml[cameraEnd - 1] == '/') {
+		xml.replace(cameraEnd - 1, 2, ">" + element.str() + "</Camera>");
+		return true;
+	}
+	size_t close = xml.find("</Camera>", cameraEnd);
+	size_t existing = xml.find("<AntiAliasing", cameraEnd);
+	if (existing != std::string::npos && existing < close) {
+		size_t existingEnd = xml.find("/>", existing);
+		if (existingEnd == std::string::npos) {
+			return false;
+		}
+		xml.replace(existing, existingEnd + 2 - existing, element.str());
+	}
+	else {
+		xml.insert(cameraEnd + 1, element.str());
+	}
+	return true;
+}
+
+bool budgetOpen(const ConfigData* data, int argc, char* argv[]) {
+	if (data -> timeBudget <= 0.0f) {
+		return false;
+	}
+	FrameSet frames;
+	frames.configArg = -1;
+	for (int i = 0; i < argc; ++i) {
+		frames.args.push_back(argv[i]);
+		if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+			frames.configArg = i + 1;
+		}
+	}
+	if (frames.configArg < 0) {
+		std::cerr << "ERROR: A time budget requires -c <ConfigFile>." << std::endl;
+		return true;
+	}
+	frames.config = frames.args[frames.configArg];
+	std::ifstream in(frames.config.c_str());
+	std::stringstream buffer;
+	buffer << in.rdbuf();
+	std::string xml = buffer.str();
+	std::string preview = xml;
+	if (!in || !setSupersampling(xml, data -> refineSamples) || !setSupersampling(preview, 1)) {
+		std::cerr << "ERROR: Could not read the camera of " << frames.config << std::endl;
+		return true;
+	}
+
+	char path[] = "/tmp/rt_refineXXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		std::cerr << "ERROR: Could not create the refinement scene." << std::endl;
+		return true;
+	}
+	close(fd);
+	std::ofstream file(path);
+	file << xml;
+	file.close();
+	frames.args[frames.configArg] = path;
+	setDefaultOptions(&refineScene);
+	refineScene.mpi_rank = refineScene.mpi_procs = 0;
+	bool result = !file || initializeFrame(&refineScene, &frames, -1);
+	unlink(path);
+	refineLoaded = !result;
+	if (result) {
+		return true;
+	}
+
+	//The previews are one ray per pixel whatever the scene asks for, so a
+	//supersampled scene cannot spend the budget before any refinement. -c
+	//is pointed at the rewritten scene until initialize() has loaded it.
+	char previewName[] = "/tmp/rt_previewXXXXXX";
+	fd = mkstemp(previewName);
+	if (fd < 0) {
+		std::cerr << "ERROR: Could not create the preview scene." << std::endl;
+		return true;
+	}
+	close(fd);
+	std::ofstream previewFile(previewName);
+	previewFile << preview;
+	previewFile.close();
+	if (!previewFile) {
+		std::cerr << "ERROR: Could not write the preview scene." << std::endl;
+		unlink(previewName);
+		return true;
+	}
+	previewPath = previewName;
+	argv[frames.configArg] = &previewPath[0];
+	return false;
+}
+
+bool budgetCheck(const ConfigData* data) {
+	if (data -> timeBudget <= 0.0f) {
+		return false;
+	}
+	//initialize() has read the preview scene.
+	if (!previewPath.empty()) {
+		unlink(previewPath.c_str());
+	}
+	if (data -> partitioningMode != PART_MODE_DYNAMIC || data -> dynamicRMA || data -> hierarchical ||
+		!data -> checkpointFile.empty() || !data -> cameraPath.empty() || data -> mpi_procs < 2) {
+		if (data -> mpi_rank == 0) {
+			std::cerr << "ERROR: -timebudget needs -p dynamic with at least 2 processes and without -rma, -hier, -checkpoint or -path." << std::endl;
+		}
+		return true;
+	}
+	return false;
+}
+
+void budgetClose() {
+	if (refineLoaded) {
+		shutdown(&refineScene);
+		refineLoaded = false;
+	}
+}
+
+//The spread of the luminance of a block.
+static double luminanceSpread(const float* pixels, int numPixels) {
+	double sum = 0.0, squares = 0.0;
+	for (int i = 0; i < numPixels; ++i) {
+		double y = 0.2126 * pixels[3 * i] + 0.7152 * pixels[3 * i + 1] + 0.0722 * pixels[3 * i + 2];
+		sum += y;
+		squares += y * y;
+	}
+	double mean = sum / numPixels;
+	return std::sqrt(std::max(0.0, squares / numPixels - mean * mean));
+}
+
+void masterBudgetPartition(ConfigData* data, float* pixels) {
+	DynamicBlock dynamicBlock = DynamicBlock(data);
+	MPI_Status status;
+	int size = dynamicBlock.getSize();
+	int numBlocks = dynamicBlock.numBlocksWide * dynamicBlock.numBlocksTall;
+	float* packet = new float[size];
+
+	//Every rank measures the budget from the same barrier.
+	MPI_Barrier(MPI_COMM_WORLD);
+	double start = MPI_Wtime();
+	double deadline = start + data -> timeBudget / 1000.0;
+
+	//Block IDs below numBlocks are previews; numBlocks + b refines block b.
+	std::vector<double> previewTime(numBlocks, 0.0);
+	std::vector<double> slaveTime(data -> mpi_procs, 0.0);
+	std::vector<int> slaveJob(data -> mpi_procs, -1);
+	std::vector<bool> rendered(numBlocks, false);
+	std::priority_queue<std::pair<double, int> > candidates;
+	//How much longer a refinement takes than its preview, learned as
+	//refinements come back.
+	double refineRatio = (double)data -> refineSamples * data -> refineSamples;
+	double refineTime = 0.0, refinedPreviewTime = 0.0;
+	//Slaves past the last block start out done, like in slaveBudgetPartition.
+	int busySlaves = std::min(data -> mpi_procs - 1, numBlocks);
+	int nextPreview = busySlaves;
+	int previews = 0, refined = 0, dropped = 0, skipped = 0, missing = 0;
+	double previewDone = 0.0;
+	for (int slave = 1; slave <= busySlaves; ++slave) {
+		slaveJob[slave] = slave - 1;
+	}
+
+	countersPhase(COUNTER_PHASE_COMMUNICATE);
+	double communicationStart = MPI_Wtime();
+	while (busySlaves > 0) {
+		double recvStart = traceNow();
+		MPI_Recv(packet, size, MPI_FLOAT, MPI_ANY_SOURCE, 8, MPI_COMM_WORLD, &status);
+		traceEvent("recv", recvStart);
+		int slave = packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_SLAVE];
+		int slaveBlockID = packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_BLOCK_ID];
+		double time = packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_COMPUTATION_TIME] - slaveTime[slave];
+		slaveTime[slave] = packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_COMPUTATION_TIME];
+		int job = slaveJob[slave];
+		int block = job % numBlocks;
+
+		//A refinement cut off by the deadline comes back with ID -1.
+		dynamicBlock.updateDynamicBlockData(data, block);
+		if (slaveBlockID < 0) {
+			++dropped;
+		}
+		else {
+			for (int row = 0; row < dynamicBlock.blockRowNum; ++row) {
+				memcpy(&(pixels[getIndex(data, dynamicBlock.blockRowStart + row, dynamicBlock.blockColStart)]),
+					&(packet[dynamicBlock.getIndex(row, 0)]), 3 * dynamicBlock.blockColNum * sizeof(float));
+			}
+			rendered[block] = true;
+			if (job < numBlocks) {
+				previewTime[block] = time;
+				double spread = luminanceSpread(&(packet[DynamicBlock::DYNAMIC_PACKET_MAX]), dynamicBlock.blockRowNum * dynamicBlock.blockColNum);
+				candidates.push(std::make_pair(time * spread, block));
+				++previews;
+				previewDone = MPI_Wtime() - start;
+			}
+			else {
+				++refined;
+				refineTime += time;
+				refinedPreviewTime += previewTime[block];
+				if (refinedPreviewTime > 0.0) {
+					refineRatio = refineTime / refinedPreviewTime;
+				}
+			}
+		}
+
+		//Previews first, as long as the deadline has not passed; then the
+		//best refinement that fits before the deadline. The others will not
+		//fit later either.
+		int next = -1;
+		double now = MPI_Wtime();
+		if (nextPreview < numBlocks && now <= deadline) {
+			next = nextPreview++;
+		}
+		else if (nextPreview < numBlocks) {
+			missing += numBlocks - nextPreview;
+			nextPreview = numBlocks;
+		}
+		else {
+			while (!candidates.empty() && next < 0) {
+				int candidate = candidates.top().second;
+				candidates.pop();
+				if (now + refineRatio * previewTime[candidate] <= deadline) {
+					next = numBlocks + candidate;
+				}
+				else {
+					++skipped;
+				}
+			}
+		}
+		slaveJob[slave] = next;
+		if (next < 0) {
+			--busySlaves;
+		}
+		double sendStart = traceNow();
+		MPI_Send(&next, 1, MPI_INT, slave, MPI_TAG_DYNAMIC, MPI_COMM_WORLD);
+		traceEvent("send", sendStart);
+	}
+	double elapsed = MPI_Wtime() - start;
+	double communicationTime = MPI_Wtime() - communicationStart;
+
+	//Blocks can be rendered twice, so the log average comes from the
+	//final image rather than from the slaves. Missing blocks are black and
+	//are left out of it.
+	if (data -> toneMode != TONE_MODE_NONE) {
+		double partial[2] = {0.0, 0.0};
+		for (int block = 0; block < numBlocks; ++block) {
+			if (!rendered[block]) {
+				continue;
+			}
+			dynamicBlock.updateDynamicBlockData(data, block);
+			for (int row = 0; row < dynamicBlock.blockRowNum; ++row) {
+				accumulateLogLuminance(data, &(pixels[getIndex(data, dynamicBlock.blockRowStart + row, dynamicBlock.blockColStart)]),
+					dynamicBlock.blockColNum, partial);
+			}
+		}
+		double reduceStart = traceNow();
+		double logAverage = reduceLogAverageLuminance(partial, MPI_COMM_WORLD);
+		traceEvent("reduce", reduceStart);
+		toneMapPixels(data, pixels, data -> width * data -> height, logAverage);
+	}
+	countersPhase(COUNTER_PHASE_NONE);
+
+	double computationTime = 0.0;
+	for (int slave = 1; slave < data -> mpi_procs; ++slave) {
+		computationTime = std::max(computationTime, slaveTime[slave]);
+	}
+	if (missing > 0) {
+		std::cerr << "WARNING: The previews did not fit in the time budget; " << missing << " of " << numBlocks
+			<< " blocks were not rendered." << std::endl;
+	}
+	else if (previewDone > data -> timeBudget / 1000.0) {
+		std::cerr << "WARNING: The previews alone took " << 1000.0 * previewDone << " of " << data -> timeBudget << " ms." << std::endl;
+	}
+	std::cout << "Preview Time: " << previewDone << " seconds" << std::endl;
+	std::cout << "Missing Blocks: " << missing << " of " << numBlocks << std::endl;
+	std::cout << "Refined Blocks: " << refined << " of " << numBlocks << " (" << dropped << " cut off at the deadline, "
+		<< skipped << " would not fit)" << std::endl;
+	std::cout << "Time Budget: " << 1000.0 * elapsed << " of " << data -> timeBudget << " ms" << std::endl;
+	std::cout << "Total Computation Time: " << computationTime << " seconds" << std::endl;
+	std::cout << "Total Communication Time: " << communicationTime << " seconds" << std::endl;
+	std::cout << "C-to-C Ratio: " << communicationTime / computationTime << std::endl;
+	delete[] packet;
+}
+
+void slaveBudgetPartition(ConfigData* data) {
+	MPI_Status status;
+	DynamicBlock dynamicBlock = DynamicBlock(data);
+	int size = dynamicBlock.getSize();
+	int numBlocks = dynamicBlock.numBlocksWide * dynamicBlock.numBlocksTall;
+	float* packet = new float[size];
+	refineScene.mpi_rank = data -> mpi_rank;
+	refineScene.mpi_procs = data -> mpi_procs;
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	double deadline = MPI_Wtime() + data -> timeBudget / 1000.0;
+	double computationTime = 0.0;
+	//With fewer blocks than slaves, the last slaves have nothing to do.
+	int blockID = data -> mpi_rank - 1 < numBlocks ? data -> mpi_rank - 1 : -1;
+	while (blockID != -1) {
+		bool refine = blockID >= numBlocks;
+		ConfigData* scene = refine ? &refineScene : data;
+		dynamicBlock.updateDynamicBlockData(data, blockID % numBlocks);
+		countersPhase(COUNTER_PHASE_COMPUTE);
+		double computationStart = MPI_Wtime();
+		bool complete = true;
+		for (int row = 0; row < dynamicBlock.blockRowNum && complete; ++row) {
+			//Previews always finish; refinements stop at the deadline.
+			if (refine && MPI_Wtime() > deadline) {
+				complete = false;
+				break;
+			}
+			for (int col = 0; col < dynamicBlock.blockColNum; ++col) {
+				shadeTracedPixel(&(packet[dynamicBlock.getIndex(row, col)]), row + dynamicBlock.blockRowStart, col + dynamicBlock.blockColStart, scene);
+			}
+		}
+		traceTile(dynamicBlock.blockRowStart, dynamicBlock.blockColStart, dynamicBlock.blockRowNum, dynamicBlock.blockColNum, computationStart);
+		computationTime += MPI_Wtime() - computationStart;
+		packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_BLOCK_ID] = complete ? blockID : -1;
+		packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_SLAVE] = data -> mpi_rank;
+		packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_COMPUTATION_TIME] = computationTime;
+
+		countersPhase(COUNTER_PHASE_COMMUNICATE);
+		double sendStart = traceNow();
+		MPI_Send(packet, size, MPI_FLOAT, 0, 8, MPI_COMM_WORLD);
+		traceEvent("send", sendStart);
+		double recvStart = traceNow();
+		MPI_Recv(&blockID, 1, MPI_INT, 0, MPI_TAG_DYNAMIC, MPI_COMM_WORLD, &status);
+		traceEvent("recv", recvStart);
+	}
+	if (data -> toneMode != TONE_MODE_NONE) {
+		double partial[2] = {0.0, 0.0};
+		double reduceStart = traceNow();
+		reduceLogAverageLuminance(partial, MPI_COMM_WORLD);
+		traceEvent("reduce", reduceStart);
+	}
+	countersPhase(COUNTER_PHASE_NONE);
+	delete[] packet;
+}
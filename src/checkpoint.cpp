@@ -0,0 +1,295 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <mpi.h>
+
+#include "checkpoint.h"
+#include "master.h"
+#include "tone.h"
+#include "trace.h"
+#include "counters.h"
+
+//The writes may take at most this fraction of the elapsed render time.
+static const double CHECKPOINT_BUDGET = 0.05;
+
+static int tilesFile = -1;
+static int manifestFile = -1;
+static off_t tilesSize = 0;
+static std::vector<char> pendingTiles;
+static std::string pendingManifest;
+static int pendingBlocks = 0;
+static double interval = 0.0;
+static double renderStart = 0.0;
+static double lastWrite = 0.0;
+static double checkpointTime = 0.0;
+static double lastWriteTime = 0.0;
+static int writes = 0;
+static int blocksWritten = 0;
+static unsigned long long sceneHash = 0;
+
+//FNV-1a over the bytes of a block.
+static unsigned long long checksum(const char* bytes, size_t size) {
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= (unsigned char)bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool checkpointCheck(const ConfigData* data, int argc, char* argv[]) {
+	if (data -> checkpointFile.empty()) {
+		return false;
+	}
+	if (data -> partitioningMode != PART_MODE_DYNAMIC || data -> dynamicRMA || data -> hierarchical || !data -> cameraPath.empty()) {
+		if (data -> mpi_rank == 0) {
+			std::cerr << "ERROR: -checkpoint needs -p dynamic without -rma, -hier or -path." << std::endl;
+		}
+		return true;
+	}
+	//The camera and sampling settings are part of the scene file, and the
+	//sceneID alone does not change when they do.
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], "-c") == 0) {
+			std::ifstream in(argv[i + 1], std::ios::binary);
+			std::string xml((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+			sceneHash = checksum(xml.c_str(), xml.size());
+		}
+	}
+	return false;
+}
+
+//A checkpoint only fits the render it was written for. The manifest names
+//blocks by their row-major index, so a different -order or -costmap only
+//changes which blocks are rendered first.
+static std::string header(const ConfigData* data) {
+	std::ostringstream line;
+	line << "raytrace-checkpoint 2 " << data -> sceneID << " " << std::hex << sceneHash << std::dec << " " << data -> width << " "
+		<< data -> height << " " << data -> dynamicBlockHeight << " " << data -> dynamicBlockWidth;
+	return line.str();
+}
+
+//The row-major index of the block dynamicBlock was last updated for.
+static int rowMajorBlock(const DynamicBlock* dynamicBlock) {
+	return dynamicBlock -> yBlockID * dynamicBlock -> numBlocksWide + dynamicBlock -> xBlockID;
+}
+
+static bool writeAll(int file, const char* bytes, size_t size) {
+	while (size > 0) {
+		ssize_t written = write(file, bytes, size);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		bytes += written;
+		size -= written;
+	}
+	return true;
+}
+
+static void closeFiles() {
+	if (tilesFile >= 0) {
+		close(tilesFile);
+	}
+	if (manifestFile >= 0) {
+		close(manifestFile);
+	}
+	tilesFile = manifestFile = -1;
+	pendingTiles.clear();
+	pendingManifest.clear();
+	pendingBlocks = 0;
+}
+
+//The tiles are synced before the manifest names them, so every block in
+//the manifest is on disk whatever happens after.
+static void writePending() {
+	if (pendingBlocks == 0) {
+		return;
+	}
+	countersPhase(COUNTER_PHASE_SAVE);
+	//traceNow() is 0 without -trace, so the time comes from MPI_Wtime().
+	double start = MPI_Wtime();
+	bool failed = !writeAll(tilesFile, &pendingTiles[0], pendingTiles.size()) || fsync(tilesFile) != 0 ||
+		!writeAll(manifestFile, pendingManifest.c_str(), pendingManifest.size()) || fsync(manifestFile) != 0;
+	if (failed) {
+		std::cerr << "WARNING: Could not write the checkpoint (" << strerror(errno) << "); continuing without it." << std::endl;
+		closeFiles();
+	}
+	else {
+		tilesSize += pendingTiles.size();
+		blocksWritten += pendingBlocks;
+		pendingTiles.clear();
+		pendingManifest.clear();
+		pendingBlocks = 0;
+	}
+	++writes;
+	lastWrite = MPI_Wtime();
+	lastWriteTime = lastWrite - start;
+	checkpointTime += lastWriteTime;
+	traceEvent("checkpoint", start);
+	countersPhase(COUNTER_PHASE_COMMUNICATE);
+}
+
+//Reads the blocks named in the manifest into the image. Returns the
+//length of the manifest up to its last complete line, or -1 if it
+//belongs to another render.
+static long resume(const ConfigData* data, DynamicBlock* dynamicBlock, float* pixels, std::vector<bool>* done, double* partial) {
+	std::ifstream manifestIn((data -> checkpointFile + ".manifest").c_str(), std::ios::binary);
+	std::string manifest((std::istreambuf_iterator<char>(manifestIn)), std::istreambuf_iterator<char>());
+	//A write cut short leaves a partial last line.
+	size_t end = manifest.rfind('\n');
+	manifest.resize(end == std::string::npos ? 0 : end + 1);
+	if (manifest.empty()) {
+		return 0;
+	}
+	std::istringstream lines(manifest);
+	std::string line;
+	std::getline(lines, line);
+	if (line != header(data)) {
+		std::cerr << "ERROR: " << data -> checkpointFile << " was written for a different render." << std::endl;
+		return -1;
+	}
+	FILE* tilesIn = fopen((data -> checkpointFile + ".tiles").c_str(), "rb");
+	if (tilesIn == NULL) {
+		return manifest.size();
+	}
+	//The block IDs are positions in this render's schedule.
+	int numBlocks = done -> size();
+	std::vector<int> blockIDs(numBlocks);
+	for (int blockID = 0; blockID < numBlocks; ++blockID) {
+		dynamicBlock -> updateDynamicBlockData(data, blockID);
+		blockIDs[rowMajorBlock(dynamicBlock)] = blockID;
+	}
+	std::vector<float> tile;
+	while (std::getline(lines, line)) {
+		std::istringstream entry(line);
+		int block, count;
+		long long offset;
+		unsigned long long sum;
+		if (!(entry >> block >> offset >> count >> sum) || block < 0 || block >= numBlocks || (*done)[blockIDs[block]]) {
+			continue;
+		}
+		int blockID = blockIDs[block];
+		dynamicBlock -> updateDynamicBlockData(data, blockID);
+		if (count != dynamicBlock -> getNumOfPixels()) {
+			continue;
+		}
+		tile.resize(count);
+		if (fseeko(tilesIn, offset, SEEK_SET) != 0 || fread(&tile[0], sizeof(float), count, tilesIn) != (size_t)count ||
+			checksum((const char*)&tile[0], count * sizeof(float)) != sum) {
+			continue;
+		}
+		for (int row = 0; row < dynamicBlock -> blockRowNum; ++row) {
+			memcpy(&(pixels[getIndex(data, dynamicBlock -> blockRowStart + row, dynamicBlock -> blockColStart)]),
+				&tile[3 * row * dynamicBlock -> blockColNum], 3 * dynamicBlock -> blockColNum * sizeof(float));
+		}
+		//The slaves only sum the blocks they render.
+		if (data -> toneMode != TONE_MODE_NONE) {
+			accumulateLogLuminance(data, &tile[0], dynamicBlock -> blockRowNum * dynamicBlock -> blockColNum, partial);
+		}
+		(*done)[blockID] = true;
+	}
+	fclose(tilesIn);
+	return manifest.size();
+}
+
+bool checkpointOpen(const ConfigData* data, DynamicBlock* dynamicBlock, float* pixels, std::vector<int>* schedule, double* partial) {
+	int numBlocks = dynamicBlock -> numBlocksWide * dynamicBlock -> numBlocksTall;
+	std::vector<bool> done(numBlocks, false);
+	schedule -> clear();
+	closeFiles();
+	if (!data -> checkpointFile.empty()) {
+		long manifestSize = 0;
+		if (data -> resume) {
+			manifestSize = resume(data, dynamicBlock, pixels, &done, partial);
+			if (manifestSize < 0) {
+				return true;
+			}
+		}
+		std::string manifestName = data -> checkpointFile + ".manifest";
+		std::string tilesName = data -> checkpointFile + ".tiles";
+		//Resumed files are only appended to; the tiles keep their
+		//offsets and the manifest loses its partial last line.
+		int fresh = manifestSize == 0 ? O_TRUNC : 0;
+		manifestFile = open(manifestName.c_str(), O_WRONLY | O_CREAT | O_APPEND | fresh, 0644);
+		tilesFile = open(tilesName.c_str(), O_WRONLY | O_CREAT | O_APPEND | fresh, 0644);
+		if (manifestFile < 0 || tilesFile < 0 || ftruncate(manifestFile, manifestSize) != 0) {
+			std::cerr << "ERROR: Could not open the checkpoint " << data -> checkpointFile << " (" << strerror(errno) << ")." << std::endl;
+			closeFiles();
+			return true;
+		}
+		tilesSize = lseek(tilesFile, 0, SEEK_END);
+		if (manifestSize == 0) {
+			pendingManifest = header(data) + "\n";
+			if (!writeAll(manifestFile, pendingManifest.c_str(), pendingManifest.size()) || fsync(manifestFile) != 0) {
+				std::cerr << "ERROR: Could not write the checkpoint " << data -> checkpointFile << " (" << strerror(errno) << ")." << std::endl;
+				closeFiles();
+				return true;
+			}
+			pendingManifest.clear();
+		}
+		interval = data -> checkpointInterval;
+		renderStart = lastWrite = MPI_Wtime();
+		checkpointTime = 0.0;
+		lastWriteTime = 0.0;
+		writes = blocksWritten = 0;
+	}
+	int restored = 0;
+	for (int blockID = 0; blockID < numBlocks; ++blockID) {
+		if (done[blockID]) {
+			++restored;
+		}
+		else {
+			schedule -> push_back(blockID);
+		}
+	}
+	if (data -> resume) {
+		std::cout << "Resumed Blocks: " << restored << " of " << numBlocks << std::endl;
+	}
+	return false;
+}
+
+void checkpointBlock(DynamicBlock* dynamicBlock, const float* packet) {
+	if (tilesFile < 0) {
+		return;
+	}
+	int count = dynamicBlock -> getNumOfPixels();
+	const char* tile = (const char*)&(packet[DynamicBlock::DYNAMIC_PACKET_MAX]);
+	size_t size = count * sizeof(float);
+	std::ostringstream entry;
+	entry << rowMajorBlock(dynamicBlock) << " " << (long long)(tilesSize + pendingTiles.size()) << " " << count << " " << checksum(tile, size) << "\n";
+	pendingManifest += entry.str();
+	pendingTiles.insert(pendingTiles.end(), tile, tile + size);
+	++pendingBlocks;
+
+	double now = MPI_Wtime();
+	//The last write is the estimate of the next one, so the cap holds
+	//after the first write rather than being checked only afterwards.
+	if (now - lastWrite >= interval && checkpointTime + lastWriteTime <= CHECKPOINT_BUDGET * (now - renderStart)) {
+		writePending();
+	}
+}
+
+void checkpointClose() {
+	if (tilesFile < 0) {
+		return;
+	}
+	//The final write is not held to CHECKPOINT_BUDGET; it is whatever the
+	//intermediate writes left, and is reported on its own.
+	double elapsed = MPI_Wtime() - renderStart;
+	double intermediateTime = checkpointTime;
+	int finalBlocks = pendingBlocks;
+	writePending();
+	closeFiles();
+	std::cout << "Checkpoint Blocks: " << blocksWritten << " in " << writes << " writes" << std::endl;
+	std::cout << "Checkpoint Time: " << intermediateTime << " seconds (" << 100.0 * intermediateTime / elapsed << "% of the render)" << std::endl;
+	std::cout << "Checkpoint Final Write: " << checkpointTime - intermediateTime << " seconds for " << finalBlocks << " blocks" << std::endl;
+}
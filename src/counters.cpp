@@ -0,0 +1,264 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <mpi.h>
+
+#include "counters.h"
+#include "trace.h"
+
+enum {
+	COUNTER_CYCLES = 0,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_CACHE_MISSES,
+	COUNTER_BRANCH_MISSES,
+	COUNTER_FP_OPS,
+	COUNTER_MAX
+};
+
+static const char* counterNames[COUNTER_MAX] = {"cycles", "instructions", "cache_misses", "branch_misses", "fp_ops"};
+static const char* phaseNames[COUNTER_PHASE_MAX] = {"load", "compute", "communicate", "save"};
+
+//The counters are opened as one group so that they are always scheduled
+//together. slot holds the position of each counter in a group read, or
+//-1 if it could not be opened.
+static bool enabled = false;
+static int leader = -1;
+static int numOpen = 0;
+static int slot[COUNTER_MAX];
+static std::string openError;
+
+static CounterPhase current = COUNTER_PHASE_NONE;
+static double phaseStart = 0.0;
+static double last[COUNTER_MAX];
+static double seconds[COUNTER_PHASE_MAX];
+static double counts[COUNTER_PHASE_MAX][COUNTER_MAX];
+
+static int openCounter(unsigned int type, unsigned long long config, int group) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = group == -1 ? 1 : 0;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+//Reads the running totals of every open counter, scaled up if the kernel
+//had to multiplex the group.
+static void readCounters(double* values) {
+	unsigned long long buffer[3 + COUNTER_MAX];
+	memset(buffer, 0, sizeof(buffer));
+	if (leader < 0 || read(leader, buffer, sizeof(buffer)) <= 0) {
+		return;
+	}
+	double scale = buffer[2] > 0 ? (double)buffer[1] / buffer[2] : 1.0;
+	for (int i = 0; i < COUNTER_MAX; ++i) {
+		if (slot[i] >= 0) {
+			values[i] = buffer[3 + slot[i]] * scale;
+		}
+	}
+}
+
+void countersOpen(ConfigData* data) {
+	enabled = data -> counters;
+	if (!enabled) {
+		return;
+	}
+	//The -autotune calibration renders before this; only the image counts.
+	resetShadedPixelCount();
+	const unsigned int types[COUNTER_MAX] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_RAW};
+	const unsigned long long configs[COUNTER_MAX] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES, data -> fpEvent};
+	for (int i = 0; i < COUNTER_MAX; ++i) {
+		slot[i] = -1;
+		last[i] = 0.0;
+		if (i == COUNTER_FP_OPS && data -> fpEvent == 0) {
+			continue;
+		}
+		int fd = openCounter(types[i], configs[i], leader);
+		if (fd < 0) {
+			if (openError.empty()) {
+				openError = strerror(errno);
+			}
+			continue;
+		}
+		if (leader < 0) {
+			leader = fd;
+		}
+		slot[i] = numOpen++;
+	}
+	for (int p = 0; p < COUNTER_PHASE_MAX; ++p) {
+		seconds[p] = 0.0;
+		for (int i = 0; i < COUNTER_MAX; ++i) {
+			counts[p][i] = 0.0;
+		}
+	}
+	if (leader >= 0) {
+		ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+	current = COUNTER_PHASE_NONE;
+}
+
+void countersPhase(CounterPhase phase) {
+	if (!enabled) {
+		return;
+	}
+	double now = MPI_Wtime();
+	double values[COUNTER_MAX];
+	memcpy(values, last, sizeof(values));
+	readCounters(values);
+	if (current != COUNTER_PHASE_NONE) {
+		seconds[current] += now - phaseStart;
+		for (int i = 0; i < COUNTER_MAX; ++i) {
+			counts[current][i] += values[i] - last[i];
+		}
+	}
+	memcpy(last, values, sizeof(values));
+	current = phase;
+	phaseStart = now;
+}
+
+//The name -p takes for mode.
+static const char* modeName(PartType mode) {
+	switch (mode) {
+	case PART_MODE_NONE:
+		return "none";
+	case PART_MODE_STATIC_STRIPS_HORIZONTAL:
+		return "static_strips_horizontal";
+	case PART_MODE_STATIC_STRIPS_VERTICAL:
+		return "static_strips_vertical";
+	case PART_MODE_STATIC_BLOCKS:
+		return "static_blocks";
+	case PART_MODE_STATIC_CYCLES_HORIZONTAL:
+		return "static_cycles_horizontal";
+	case PART_MODE_STATIC_CYCLES_VERTICAL:
+		return "static_cycles_vertical";
+	case PART_MODE_DYNAMIC:
+		return "dynamic";
+	}
+	return "unknown";
+}
+
+static void printCount(std::ostream& out, double value) {
+	if (value < 0.0) {
+		out << "n/a";
+	}
+	else {
+		out << (long long)value;
+	}
+}
+
+void countersReport(ConfigData* data, const std::string& file, long long pixels) {
+	if (!enabled) {
+		return;
+	}
+	countersPhase(COUNTER_PHASE_NONE);
+	enabled = false;
+	if (leader >= 0) {
+		ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	}
+
+	//Per rank: shaded pixels, then seconds and every counter for each phase, with
+	//-1 for the counters that are not available on that rank.
+	const int stride = 1 + COUNTER_PHASE_MAX * (1 + COUNTER_MAX);
+	std::vector<double> local(stride);
+	local[0] = pixels;
+	for (int p = 0; p < COUNTER_PHASE_MAX; ++p) {
+		double* phase = &local[1 + p * (1 + COUNTER_MAX)];
+		phase[0] = seconds[p];
+		for (int i = 0; i < COUNTER_MAX; ++i) {
+			phase[1 + i] = slot[i] >= 0 ? counts[p][i] : -1.0;
+		}
+	}
+	std::vector<double> all(data -> mpi_rank == 0 ? stride * data -> mpi_procs : 0);
+	MPI_Gather(&local[0], stride, MPI_DOUBLE, all.empty() ? NULL : &all[0], stride, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	int available = numOpen;
+	int maxAvailable;
+	MPI_Reduce(&available, &maxAvailable, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+	if (data -> mpi_rank != 0) {
+		return;
+	}
+
+	size_t dot = file.rfind('.');
+	std::string csvName = (dot == std::string::npos ? file : file.substr(0, dot)) + "_counters.csv";
+	std::ofstream csv(csvName.c_str());
+	csv << "mode,width,height,procs,rank,phase,seconds,pixels";
+	for (int i = 0; i < COUNTER_MAX; ++i) {
+		csv << "," << counterNames[i];
+	}
+	csv << "\n";
+
+	//Totals over the ranks that have each counter; -1 if none do.
+	double totalPixels = 0.0;
+	double maxCompute = 0.0;
+	double totalSeconds[COUNTER_PHASE_MAX];
+	double total[COUNTER_PHASE_MAX][COUNTER_MAX];
+	for (int p = 0; p < COUNTER_PHASE_MAX; ++p) {
+		totalSeconds[p] = 0.0;
+		for (int i = 0; i < COUNTER_MAX; ++i) {
+			total[p][i] = -1.0;
+		}
+	}
+	for (int rank = 0; rank < data -> mpi_procs; ++rank) {
+		const double* values = &all[rank * stride];
+		totalPixels += values[0];
+		for (int p = 0; p < COUNTER_PHASE_MAX; ++p) {
+			const double* phase = &values[1 + p * (1 + COUNTER_MAX)];
+			totalSeconds[p] += phase[0];
+			if (p == COUNTER_PHASE_COMPUTE && phase[0] > maxCompute) {
+				maxCompute = phase[0];
+			}
+			csv << modeName(data -> partitioningMode) << "," << data -> width << "," << data -> height << "," << data -> mpi_procs
+				<< "," << rank << "," << phaseNames[p] << "," << phase[0] << "," << (p == COUNTER_PHASE_COMPUTE ? (long long)values[0] : 0);
+			for (int i = 0; i < COUNTER_MAX; ++i) {
+				csv << ",";
+				if (phase[1 + i] >= 0.0) {
+					csv << (long long)phase[1 + i];
+					total[p][i] = (total[p][i] < 0.0 ? 0.0 : total[p][i]) + phase[1 + i];
+				}
+			}
+			csv << "\n";
+		}
+	}
+
+	if (maxAvailable == 0) {
+		std::cout << "Hardware counters unavailable (" << (openError.empty() ? "no events" : openError) << "); reporting time and pixels only" << std::endl;
+	}
+	for (int p = 0; p < COUNTER_PHASE_MAX; ++p) {
+		std::cout << "Counters " << phaseNames[p] << ": " << totalSeconds[p] << " s";
+		for (int i = 0; i < COUNTER_MAX; ++i) {
+			std::cout << ", " << counterNames[i] << " ";
+			printCount(std::cout, total[p][i]);
+		}
+		std::cout << std::endl;
+	}
+	double instructions = total[COUNTER_PHASE_COMPUTE][COUNTER_INSTRUCTIONS];
+	double cycles = total[COUNTER_PHASE_COMPUTE][COUNTER_CYCLES];
+	std::cout << "Shaded Pixels: " << (long long)totalPixels << std::endl;
+	std::cout << "Pixels per Second: " << (maxCompute > 0.0 ? totalPixels / maxCompute : 0.0) << std::endl;
+	std::cout << "Instructions per Pixel: ";
+	if (instructions >= 0.0 && totalPixels > 0.0) {
+		std::cout << instructions / totalPixels << std::endl;
+	}
+	else {
+		std::cout << "n/a" << std::endl;
+	}
+	std::cout << "Instructions per Cycle: ";
+	if (instructions >= 0.0 && cycles > 0.0) {
+		std::cout << instructions / cycles << std::endl;
+	}
+	else {
+		std::cout << "n/a" << std::endl;
+	}
+	std::cout << "Counters saved to: " << csvName << std::endl;
+}
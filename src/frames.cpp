@@ -0,0 +1,221 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <unistd.h>
+#include <mpi.h>
+
+#include "frames.h"
+
+//The time this rank spent reloading the scene for frames.
+static double reloadTime = 0.0;
+static int reloads = 0;
+
+static void lerp(const float* a, const float* b, float t, float* out) {
+	for (int i = 0; i < 3; ++i) {
+		out[i] = a[i] + t * (b[i] - a[i]);
+	}
+}
+
+//An interpolated up vector is shorter than the keyframes'; one that
+//vanishes (opposite keyframes) is left for the scene parser to reject.
+static void normalize(float* v) {
+	float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (length > 0.0f) {
+		for (int i = 0; i < 3; ++i) {
+			v[i] /= length;
+		}
+	}
+}
+
+bool readCameraPath(const ConfigData* data, int argc, char* argv[], FrameSet* frames) {
+	std::ifstream in(data -> cameraPath.c_str());
+	if (!in) {
+		std::cerr << "ERROR: Could not open the camera path " << data -> cameraPath << std::endl;
+		return true;
+	}
+	std::vector<CameraFrame> keys;
+	std::string line;
+	while (std::getline(in, line)) {
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#') {
+			continue;
+		}
+		std::istringstream values(line);
+		CameraFrame key;
+		values >> key.eye[0] >> key.eye[1] >> key.eye[2]
+			>> key.lookAt[0] >> key.lookAt[1] >> key.lookAt[2]
+			>> key.up[0] >> key.up[1] >> key.up[2];
+		if (!values) {
+			std::cerr << "ERROR: Camera path keyframes need 9 values: " << line << std::endl;
+			return true;
+		}
+		keys.push_back(key);
+	}
+	if (keys.empty()) {
+		std::cerr << "ERROR: The camera path " << data -> cameraPath << " has no keyframes." << std::endl;
+		return true;
+	}
+
+	int numFrames = data -> numFrames > 0 ? data -> numFrames : (int)keys.size();
+	frames -> cameras.resize(numFrames);
+	for (int frame = 0; frame < numFrames; ++frame) {
+		float t = numFrames > 1 ? (float)frame * (keys.size() - 1) / (numFrames - 1) : 0.0f;
+		int key = (int)t;
+		if (key >= (int)keys.size() - 1) {
+			frames -> cameras[frame] = keys.back();
+			continue;
+		}
+		t -= key;
+		CameraFrame& camera = frames -> cameras[frame];
+		lerp(keys[key].eye, keys[key + 1].eye, t, camera.eye);
+		lerp(keys[key].lookAt, keys[key + 1].lookAt, t, camera.lookAt);
+		lerp(keys[key].up, keys[key + 1].up, t, camera.up);
+		normalize(camera.up);
+	}
+
+	frames -> configArg = -1;
+	frames -> args.clear();
+	for (int i = 0; i < argc; ++i) {
+		frames -> args.push_back(argv[i]);
+		if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+			frames -> configArg = i + 1;
+		}
+	}
+	if (frames -> configArg < 0) {
+		std::cerr << "ERROR: A camera path requires -c <ConfigFile>." << std::endl;
+		return true;
+	}
+	frames -> config = frames -> args[frames -> configArg];
+	return false;
+}
+
+//Returns the value of attribute name inside the tag starting at start.
+static std::string attribute(const std::string& xml, size_t start, const std::string& name) {
+	size_t end = xml.find('>', start);
+	size_t pos = xml.find(" " + name + "=\"", start);
+	if (pos == std::string::npos || pos > end) {
+		return "";
+	}
+	pos += name.size() + 3;
+	return xml.substr(pos, xml.find('"', pos) - pos);
+}
+
+//Replaces the <tag ID="id" ... /> element with one holding the given
+//coordinates.
+static bool replaceElement(std::string& xml, const std::string& tag, const std::string& id, const float* v) {
+	size_t start = xml.find("<" + tag + " ID=\"" + id + "\"");
+	if (start == std::string::npos) {
+		return false;
+	}
+	size_t end = xml.find("/>", start);
+	if (end == std::string::npos) {
+		return false;
+	}
+	std::ostringstream element;
+	element << "<" << tag << " ID=\"" << id << "\" X=\"" << v[0] << "\" Y=\"" << v[1] << "\" Z=\"" << v[2] << "\" />";
+	xml.replace(start, end + 2 - start, element.str());
+	return true;
+}
+
+static bool writeFrameConfig(const FrameSet* frames, int frame, const std::string& out) {
+	std::ifstream in(frames -> config.c_str());
+	if (!in) {
+		std::cerr << "ERROR: Could not open the scene " << frames -> config << std::endl;
+		return true;
+	}
+	std::stringstream buffer;
+	buffer << in.rdbuf();
+	std::string xml = buffer.str();
+
+	size_t camera = xml.find("<Camera ");
+	if (camera == std::string::npos) {
+		std::cerr << "ERROR: The scene " << frames -> config << " has no <Camera> element." << std::endl;
+		return true;
+	}
+	const CameraFrame& c = frames -> cameras[frame];
+	if (!replaceElement(xml, "Point", attribute(xml, camera, "EyePoint"), c.eye) ||
+		!replaceElement(xml, "Point", attribute(xml, camera, "LookAt"), c.lookAt) ||
+		!replaceElement(xml, "Vector", attribute(xml, camera, "Up"), c.up)) {
+		std::cerr << "ERROR: Could not find the camera points in " << frames -> config << std::endl;
+		return true;
+	}
+
+	std::ofstream file(out.c_str());
+	file << xml;
+	return !file;
+}
+
+bool initializeFrame(ConfigData* data, const FrameSet* frames, int frame) {
+	char path[] = "/tmp/rt_frameXXXXXX";
+	std::vector<std::string> args = frames -> args;
+	if (frame >= 0) {
+		int fd = mkstemp(path);
+		if (fd < 0) {
+			std::cerr << "ERROR: Could not create a scene file for frame " << frame << std::endl;
+			return true;
+		}
+		close(fd);
+		if (writeFrameConfig(frames, frame, path)) {
+			unlink(path);
+			return true;
+		}
+		args[frames -> configArg] = path;
+	}
+
+	std::vector<char*> argv;
+	for (size_t i = 0; i < args.size(); ++i) {
+		argv.push_back(&args[i][0]);
+	}
+	argv.push_back(NULL);
+	int argc = (int)args.size();
+	char** argvp = &argv[0];
+
+	//initialize() fills in everything it parses, so keep what it does not.
+	int rank = data -> mpi_rank;
+	int procs = data -> mpi_procs;
+	bool result = initialize(&argc, &argvp, data);
+	data -> mpi_rank = rank;
+	data -> mpi_procs = procs;
+	data -> frameIndex = frame;
+	if (frame >= 0) {
+		unlink(path);
+	}
+	return result;
+}
+
+bool loadFrame(ConfigData* data, const FrameSet* frames, int frame) {
+	double start = MPI_Wtime();
+	shutdown(data);
+	bool result = initializeFrame(data, frames, frame);
+	reloadTime += MPI_Wtime() - start;
+	++reloads;
+	return result;
+}
+
+void reportFrameLoads(const ConfigData* data) {
+	double local[2] = {reloadTime, (double)reloads};
+	double total[2];
+	MPI_Reduce(local, total, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+	if (data -> mpi_rank == 0 && total[1] > 0.0) {
+		std::cout << "Scene Reloads: " << (long long)total[1] << " on all ranks, " << total[0] / total[1] << " seconds each" << std::endl;
+	}
+	reloadTime = 0.0;
+	reloads = 0;
+}
+
+std::string frameFileName(const ConfigData* data, std::string file) {
+	if (data -> frameIndex < 0) {
+		return file;
+	}
+	char suffix[16];
+	snprintf(suffix, sizeof(suffix), "_f%04d", data -> frameIndex);
+	size_t dot = file.rfind('.');
+	if (dot == std::string::npos) {
+		return file + suffix;
+	}
+	return file.insert(dot, suffix);
+}
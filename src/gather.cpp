@@ -0,0 +1,98 @@
+#include <iostream>
+#include <cstring>
+#include <climits>
+#include <mpi.h>
+
+#include "gather.h"
+
+//Split once; the layout of the job does not change while it runs.
+static MPI_Comm nodeComm = MPI_COMM_NULL;
+static MPI_Comm leaderComm = MPI_COMM_NULL;
+static bool split = false;
+
+void PackedRegions::add(int rowStart, int colStart, int rows, int cols, const float* pixels) {
+	int header[4] = {rowStart, colStart, rows, cols};
+	size_t offset = values.size();
+	size_t size = 3 * (size_t)rows * cols;
+	values.resize(offset + 4 + size);
+	memcpy(&values[offset], header, sizeof(header));
+	memcpy(&values[offset + 4], pixels, size * sizeof(float));
+}
+
+static void splitNodes(const ConfigData* data) {
+	if (split) {
+		return;
+	}
+	split = true;
+	//Keying by rank keeps rank 0 first on its node and first among the
+	//leaders.
+	MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, data -> mpi_rank, MPI_INFO_NULL, &nodeComm);
+	int nodeRank;
+	MPI_Comm_rank(nodeComm, &nodeRank);
+	MPI_Comm_split(MPI_COMM_WORLD, nodeRank == 0 ? 0 : MPI_UNDEFINED, data -> mpi_rank, &leaderComm);
+	if (data -> mpi_rank == 0) {
+		int nodes;
+		MPI_Comm_size(leaderComm, &nodes);
+		std::cout << "Hierarchical Gather Nodes: " << nodes << std::endl;
+	}
+}
+
+//Gathers the packed buffers of comm on its rank 0, back to back. MPI
+//counts and displacements are ints of floats, so a gather whose counts or
+//displacements would not fit (8 GB) is rejected rather than wrapped.
+static std::vector<float> gatherValues(MPI_Comm comm, const std::vector<float>& values) {
+	int rank, procs;
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &procs);
+	if (values.size() > (size_t)INT_MAX) {
+		std::cerr << "ERROR: The rendered regions are too large to gather." << std::endl;
+		MPI_Abort(MPI_COMM_WORLD, MPI_ERR_COUNT);
+	}
+	int count = values.size();
+	std::vector<int> counts(procs), offsets(procs);
+	MPI_Gather(&count, 1, MPI_INT, &counts[0], 1, MPI_INT, 0, comm);
+	long long total = 0;
+	for (int i = 0; i < procs; ++i) {
+		if (total > INT_MAX) {
+			std::cerr << "ERROR: The rendered regions are too large to gather." << std::endl;
+			MPI_Abort(MPI_COMM_WORLD, MPI_ERR_COUNT);
+		}
+		offsets[i] = total;
+		total += counts[i];
+	}
+	std::vector<float> all(rank == 0 ? total : 0);
+	MPI_Gatherv(values.empty() ? NULL : (void*)&values[0], count, MPI_FLOAT, all.empty() ? NULL : &all[0],
+		&counts[0], &offsets[0], MPI_FLOAT, 0, comm);
+	return all;
+}
+
+static void unpackRegions(const ConfigData* data, const std::vector<float>& values, float* pixels) {
+	size_t offset = 0;
+	while (offset < values.size()) {
+		int header[4];
+		memcpy(header, &values[offset], sizeof(header));
+		offset += 4;
+		size_t rowSize = 3 * (size_t)header[3];
+		for (int row = 0; row < header[2]; ++row) {
+			memcpy(&pixels[3 * ((size_t)(header[0] + row) * data -> width + header[1])], &values[offset], rowSize * sizeof(float));
+			offset += rowSize;
+		}
+	}
+}
+
+void gatherRegions(const ConfigData* data, const PackedRegions* regions, float* pixels, double* computationTime) {
+	splitNodes(data);
+	std::vector<float> empty;
+	std::vector<float> node = gatherValues(nodeComm, regions == NULL ? empty : regions -> values);
+	if (leaderComm != MPI_COMM_NULL) {
+		std::vector<float> all = gatherValues(leaderComm, node);
+		if (data -> mpi_rank == 0) {
+			unpackRegions(data, all, pixels);
+		}
+	}
+	double maxTime;
+	MPI_Reduce(computationTime, &maxTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+	if (data -> mpi_rank == 0) {
+		*computationTime = maxTime;
+	}
+}
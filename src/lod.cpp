@@ -0,0 +1,786 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <set>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <mpi.h>
+
+#include "lod.h"
+#include "frames.h"
+
+static const int MIN_GRID = 4;
+static const int MAX_GRID = 1024;
+//A level is only kept while it drops at least a tenth of the triangles.
+static const float MIN_REDUCTION = 0.9f;
+
+typedef struct ObjCorner {
+	int v, t, n;
+} ObjCorner;
+
+typedef struct ObjTriangle {
+	ObjCorner c[3];
+	int material;
+} ObjTriangle;
+
+//The parts of an OBJ file the simplification keeps. Texture coordinates
+//and normals are copied unchanged and stay attached to the corners.
+typedef struct ObjMesh {
+	std::vector<float> positions;
+	std::vector<std::string> attributes;
+	std::vector<std::string> libraries;
+	std::vector<std::string> materials;
+	std::vector<ObjTriangle> triangles;
+} ObjMesh;
+
+//The plane quadric of a cluster and the mean of its vertices.
+typedef struct Cluster {
+	double a[6];
+	double b[3];
+	double sum[3];
+	int count;
+	int index;
+} Cluster;
+
+typedef struct LodLevel {
+	int grid;
+	int triangles;
+	int vertices;
+	double buildTime;
+} LodLevel;
+
+typedef struct LodModel {
+	float bounds[6];
+	int triangles;
+	int vertices;
+	bool built;
+	std::vector<LodLevel> levels;
+} LodModel;
+
+typedef struct LodMatrix {
+	std::string type;
+	float v[3];
+} LodMatrix;
+
+//64-bit FNV-1a.
+static unsigned long long hashBytes(unsigned long long hash, const char* bytes, size_t size) {
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ (unsigned char)bytes[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool readFile(const std::string& path, std::string* contents) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in) {
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << in.rdbuf();
+	*contents = buffer.str();
+	return true;
+}
+
+//Writes to a temporary file and renames it, so that ranks sharing the
+//cache never read a partial file.
+static bool writeFile(const std::string& path, const std::string& contents) {
+	std::string temp = path + ".XXXXXX";
+	int fd = mkstemp(&temp[0]);
+	if (fd < 0) {
+		return false;
+	}
+	bool result = write(fd, contents.c_str(), contents.size()) == (ssize_t)contents.size();
+	result = close(fd) == 0 && result;
+	if (!result || rename(temp.c_str(), path.c_str()) != 0) {
+		unlink(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+static std::string directoryOf(const std::string& path) {
+	size_t slash = path.rfind('/');
+	return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+}
+
+static std::string baseName(const std::string& path) {
+	size_t slash = path.rfind('/');
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+//Returns the value of an attribute of the element starting at tag.
+static std::string attribute(const std::string& xml, size_t tag, const char* name) {
+	size_t end = xml.find('>', tag);
+	std::string key = std::string(" ") + name + "=\"";
+	size_t found = xml.find(key, tag);
+	if (found == std::string::npos || found > end) {
+		return "";
+	}
+	found += key.size();
+	return xml.substr(found, xml.find('"', found) - found);
+}
+
+//Returns the text of the first <name> element between begin and end.
+static std::string element(const std::string& xml, size_t begin, size_t end, const char* name) {
+	std::string open = std::string("<") + name + ">";
+	size_t found = xml.find(open, begin);
+	if (found == std::string::npos || found > end) {
+		return "";
+	}
+	found += open.size();
+	return xml.substr(found, xml.find('<', found) - found);
+}
+
+//Parses one face corner: v, v/t, v//n or v/t/n, with negative indices
+//counting back from the last element read.
+static bool readCorner(const std::string& token, int positions, int texcoords, int normals, ObjCorner* corner) {
+	int counts[3] = {positions, texcoords, normals};
+	int values[3] = {-1, -1, -1};
+	const char* at = token.c_str();
+	for (int i = 0; i < 3 && *at != '\0'; ++i) {
+		if (*at != '/') {
+			char* end;
+			long value = strtol(at, &end, 10);
+			if (end == at || value == 0) {
+				return false;
+			}
+			values[i] = value > 0 ? (int)value - 1 : counts[i] + (int)value;
+			if (values[i] < 0 || values[i] >= counts[i]) {
+				return false;
+			}
+			at = end;
+		}
+		if (*at == '/') {
+			++at;
+		}
+	}
+	corner -> v = values[0];
+	corner -> t = values[1];
+	corner -> n = values[2];
+	return values[0] >= 0;
+}
+
+static bool readMesh(const std::string& text, ObjMesh* mesh) {
+	std::istringstream lines(text);
+	std::string line;
+	int texcoords = 0, normals = 0;
+	int material = -1;
+	while (std::getline(lines, line)) {
+		std::istringstream tokens(line);
+		std::string type;
+		tokens >> type;
+		if (type == "v") {
+			float p[3];
+			if (!(tokens >> p[0] >> p[1] >> p[2])) {
+				return false;
+			}
+			mesh -> positions.insert(mesh -> positions.end(), p, p + 3);
+		}
+		else if (type == "vt" || type == "vn") {
+			line.erase(line.find_last_not_of(" \t\r") + 1);
+			mesh -> attributes.push_back(line);
+			++(type == "vt" ? texcoords : normals);
+		}
+		else if (type == "mtllib") {
+			std::string name;
+			while (tokens >> name) {
+				mesh -> libraries.push_back(name);
+			}
+		}
+		else if (type == "usemtl") {
+			std::string name;
+			tokens >> name;
+			material = -1;
+			for (size_t i = 0; i < mesh -> materials.size(); ++i) {
+				if (mesh -> materials[i] == name) {
+					material = (int)i;
+				}
+			}
+			if (material < 0) {
+				material = (int)mesh -> materials.size();
+				mesh -> materials.push_back(name);
+			}
+		}
+		else if (type == "f") {
+			//Polygons are split into fans.
+			std::vector<ObjCorner> corners;
+			std::string token;
+			while (tokens >> token) {
+				ObjCorner corner;
+				if (!readCorner(token, (int)mesh -> positions.size() / 3, texcoords, normals, &corner)) {
+					return false;
+				}
+				corners.push_back(corner);
+			}
+			for (size_t i = 2; i < corners.size(); ++i) {
+				ObjTriangle triangle = {{corners[0], corners[i - 1], corners[i]}, material};
+				mesh -> triangles.push_back(triangle);
+			}
+		}
+	}
+	return true;
+}
+
+static void meshBounds(const ObjMesh& mesh, float bounds[6]) {
+	for (int k = 0; k < 3; ++k) {
+		bounds[k] = mesh.positions.empty() ? 0.0f : mesh.positions[k];
+		bounds[3 + k] = bounds[k];
+	}
+	for (size_t i = 0; i < mesh.positions.size(); i += 3) {
+		for (int k = 0; k < 3; ++k) {
+			bounds[k] = std::min(bounds[k], mesh.positions[i + k]);
+			bounds[3 + k] = std::max(bounds[3 + k], mesh.positions[i + k]);
+		}
+	}
+}
+
+static float meshExtent(const float bounds[6]) {
+	return std::max(bounds[3] - bounds[0], std::max(bounds[4] - bounds[1], bounds[5] - bounds[2]));
+}
+
+//Places a cluster at the point with the least squared distance to the
+//planes of its triangles. Flat and ill-conditioned clusters, and points
+//that leave the cell, fall back to the mean of the vertices, so that no
+//vertex moves further than the diagonal of its cell.
+static void placeCluster(const Cluster& cluster, const float low[3], float cell, float out[3]) {
+	const double* a = cluster.a;
+	double m[3][3] = {{a[0], a[1], a[2]}, {a[1], a[3], a[4]}, {a[2], a[4], a[5]}};
+	double c[3][3] = {
+		{m[1][1] * m[2][2] - m[1][2] * m[2][1], m[0][2] * m[2][1] - m[0][1] * m[2][2], m[0][1] * m[1][2] - m[0][2] * m[1][1]},
+		{m[1][2] * m[2][0] - m[1][0] * m[2][2], m[0][0] * m[2][2] - m[0][2] * m[2][0], m[0][2] * m[1][0] - m[0][0] * m[1][2]},
+		{m[1][0] * m[2][1] - m[1][1] * m[2][0], m[0][1] * m[2][0] - m[0][0] * m[2][1], m[0][0] * m[1][1] - m[0][1] * m[1][0]}};
+	double det = m[0][0] * c[0][0] + m[0][1] * c[1][0] + m[0][2] * c[2][0];
+	double trace = m[0][0] + m[1][1] + m[2][2];
+	bool solved = trace > 0.0 && std::fabs(det) > 1e-3 * trace * trace * trace / 27.0;
+	for (int k = 0; k < 3 && solved; ++k) {
+		out[k] = (float)(-(c[k][0] * cluster.b[0] + c[k][1] * cluster.b[1] + c[k][2] * cluster.b[2]) / det);
+		solved = out[k] >= low[k] && out[k] <= low[k] + cell;
+	}
+	if (!solved) {
+		for (int k = 0; k < 3; ++k) {
+			out[k] = (float)(cluster.sum[k] / cluster.count);
+		}
+	}
+}
+
+//Simplifies a mesh by merging the vertices in each cell of a grid x grid
+//x grid division of its bounds into one, and drops the triangles that
+//collapse or repeat.
+static void simplifyMesh(const ObjMesh& mesh, int grid, std::vector<float>* positions, std::vector<ObjTriangle>* triangles) {
+	float bounds[6];
+	meshBounds(mesh, bounds);
+	float cell = meshExtent(bounds) / grid;
+	int numVertices = (int)mesh.positions.size() / 3;
+	std::vector<int> cellOf(numVertices);
+	std::map<long long, int> clusterOf;
+	std::vector<Cluster> clusters;
+	std::vector<long long> keys;
+	for (int i = 0; i < numVertices; ++i) {
+		long long key = 0;
+		for (int k = 0; k < 3; ++k) {
+			int index = cell > 0.0f ? (int)((mesh.positions[3 * i + k] - bounds[k]) / cell) : 0;
+			key = key * grid + std::min(std::max(index, 0), grid - 1);
+		}
+		std::map<long long, int>::iterator found = clusterOf.find(key);
+		if (found == clusterOf.end()) {
+			Cluster cluster;
+			memset(&cluster, 0, sizeof(cluster));
+			cluster.index = -1;
+			found = clusterOf.insert(std::make_pair(key, (int)clusters.size())).first;
+			clusters.push_back(cluster);
+			keys.push_back(key);
+		}
+		cellOf[i] = found -> second;
+		Cluster& cluster = clusters[found -> second];
+		for (int k = 0; k < 3; ++k) {
+			cluster.sum[k] += mesh.positions[3 * i + k];
+		}
+		++cluster.count;
+	}
+
+	//Every triangle adds its area weighted plane to its three clusters.
+	for (size_t i = 0; i < mesh.triangles.size(); ++i) {
+		const float* p[3];
+		for (int j = 0; j < 3; ++j) {
+			p[j] = &mesh.positions[3 * mesh.triangles[i].c[j].v];
+		}
+		double e1[3], e2[3];
+		for (int k = 0; k < 3; ++k) {
+			e1[k] = p[1][k] - p[0][k];
+			e2[k] = p[2][k] - p[0][k];
+		}
+		double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+		double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0.0) {
+			continue;
+		}
+		double area = 0.5 * length;
+		for (int k = 0; k < 3; ++k) {
+			n[k] /= length;
+		}
+		double d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+		for (int j = 0; j < 3; ++j) {
+			Cluster& cluster = clusters[cellOf[mesh.triangles[i].c[j].v]];
+			cluster.a[0] += area * n[0] * n[0];
+			cluster.a[1] += area * n[0] * n[1];
+			cluster.a[2] += area * n[0] * n[2];
+			cluster.a[3] += area * n[1] * n[1];
+			cluster.a[4] += area * n[1] * n[2];
+			cluster.a[5] += area * n[2] * n[2];
+			for (int k = 0; k < 3; ++k) {
+				cluster.b[k] += area * d * n[k];
+			}
+		}
+	}
+
+	positions -> clear();
+	triangles -> clear();
+	std::set<std::pair<std::pair<int, int>, int> > seen;
+	for (size_t i = 0; i < mesh.triangles.size(); ++i) {
+		int c[3];
+		for (int j = 0; j < 3; ++j) {
+			c[j] = cellOf[mesh.triangles[i].c[j].v];
+		}
+		if (c[0] == c[1] || c[1] == c[2] || c[0] == c[2]) {
+			continue;
+		}
+		int low = std::min(c[0], std::min(c[1], c[2]));
+		int high = std::max(c[0], std::max(c[1], c[2]));
+		if (!seen.insert(std::make_pair(std::make_pair(low, high), c[0] + c[1] + c[2] - low - high)).second) {
+			continue;
+		}
+		ObjTriangle triangle = mesh.triangles[i];
+		for (int j = 0; j < 3; ++j) {
+			Cluster& cluster = clusters[c[j]];
+			if (cluster.index < 0) {
+				float cellLow[3];
+				long long key = keys[c[j]];
+				for (int k = 2; k >= 0; --k) {
+					cellLow[k] = bounds[k] + (key % grid) * cell;
+					key /= grid;
+				}
+				float point[3];
+				placeCluster(cluster, cellLow, cell, point);
+				cluster.index = (int)positions -> size() / 3;
+				positions -> insert(positions -> end(), point, point + 3);
+			}
+			triangle.c[j].v = cluster.index;
+		}
+		triangles -> push_back(triangle);
+	}
+}
+
+static void writeCorner(std::ostream& out, const ObjCorner& corner) {
+	out << ' ' << corner.v + 1;
+	if (corner.t >= 0 || corner.n >= 0) {
+		out << '/';
+		if (corner.t >= 0) {
+			out << corner.t + 1;
+		}
+		if (corner.n >= 0) {
+			out << '/' << corner.n + 1;
+		}
+	}
+}
+
+static std::string meshText(const ObjMesh& mesh, const std::string& source, int grid,
+	const std::vector<float>& positions, const std::vector<ObjTriangle>& triangles) {
+	std::ostringstream out;
+	out << "# " << triangles.size() << " triangles simplified from " << source << " on a " << grid << "^3 grid" << std::endl;
+	for (size_t i = 0; i < mesh.libraries.size(); ++i) {
+		out << "mtllib " << baseName(mesh.libraries[i]) << std::endl;
+	}
+	out.precision(9);
+	for (size_t i = 0; i < positions.size(); i += 3) {
+		out << "v " << positions[i] << ' ' << positions[i + 1] << ' ' << positions[i + 2] << std::endl;
+	}
+	for (size_t i = 0; i < mesh.attributes.size(); ++i) {
+		out << mesh.attributes[i] << std::endl;
+	}
+	int material = -1;
+	for (size_t i = 0; i < triangles.size(); ++i) {
+		if (triangles[i].material != material && triangles[i].material >= 0) {
+			out << "usemtl " << mesh.materials[triangles[i].material] << std::endl;
+		}
+		material = triangles[i].material;
+		out << 'f';
+		for (int j = 0; j < 3; ++j) {
+			writeCorner(out, triangles[i].c[j]);
+		}
+		out << std::endl;
+	}
+	return out.str();
+}
+
+static size_t meshBytes(int vertices, int triangles) {
+	return (size_t)vertices * 3 * sizeof(float) + (size_t)triangles * 3 * sizeof(int);
+}
+
+static std::string levelPath(const std::string& directory, const std::string& model, int grid) {
+	std::string name = baseName(model);
+	size_t dot = name.rfind('.');
+	std::ostringstream path;
+	path << directory << name.substr(0, dot) << '_' << grid << ".obj";
+	return path.str();
+}
+
+//Reads the levels of a model from <directory>levels.txt: its bounds and
+//size on the first line, then one line per level.
+static bool readLevels(const std::string& directory, LodModel* model) {
+	std::ifstream in((directory + "levels.txt").c_str());
+	float* b = model -> bounds;
+	if (!(in >> b[0] >> b[1] >> b[2] >> b[3] >> b[4] >> b[5] >> model -> triangles >> model -> vertices)) {
+		return false;
+	}
+	LodLevel level;
+	level.buildTime = 0.0;
+	while (in >> level.grid >> level.triangles >> level.vertices) {
+		model -> levels.push_back(level);
+	}
+	model -> built = false;
+	return true;
+}
+
+//Builds the levels of a model into directory, unless an earlier run did.
+//levels.txt is written last; a directory without it is rebuilt.
+static bool buildLevels(const std::string& path, const std::string& text, const std::string& directory, LodModel* model) {
+	if (readLevels(directory, model)) {
+		return false;
+	}
+	ObjMesh mesh;
+	if (!readMesh(text, &mesh)) {
+		std::cerr << "ERROR: Could not read the mesh " << path << std::endl;
+		return true;
+	}
+	meshBounds(mesh, model -> bounds);
+	model -> triangles = (int)mesh.triangles.size();
+	model -> vertices = (int)mesh.positions.size() / 3;
+	model -> built = true;
+	model -> levels.clear();
+	//Analytic shapes have no triangles to simplify.
+	if (mesh.triangles.empty()) {
+		return false;
+	}
+	if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+		std::cerr << "ERROR: Could not create " << directory << " (" << strerror(errno) << ")." << std::endl;
+		return true;
+	}
+	//The material libraries are copied next to the levels.
+	for (size_t i = 0; i < mesh.libraries.size(); ++i) {
+		std::string library;
+		if (readFile(directoryOf(path) + mesh.libraries[i], &library) &&
+			!writeFile(directory + baseName(mesh.libraries[i]), library)) {
+			std::cerr << "ERROR: Could not write to " << directory << std::endl;
+			return true;
+		}
+	}
+	std::ostringstream index;
+	index.precision(9);
+	for (int k = 0; k < 6; ++k) {
+		index << model -> bounds[k] << ' ';
+	}
+	index << model -> triangles << ' ' << model -> vertices << std::endl;
+	for (int grid = MIN_GRID; grid <= MAX_GRID; grid *= 2) {
+		double start = MPI_Wtime();
+		std::vector<float> positions;
+		std::vector<ObjTriangle> triangles;
+		simplifyMesh(mesh, grid, &positions, &triangles);
+		if (triangles.size() >= MIN_REDUCTION * mesh.triangles.size()) {
+			break;
+		}
+		if (!writeFile(levelPath(directory, path, grid), meshText(mesh, path, grid, positions, triangles))) {
+			std::cerr << "ERROR: Could not write to " << directory << std::endl;
+			return true;
+		}
+		LodLevel level = {grid, (int)triangles.size(), (int)positions.size() / 3, MPI_Wtime() - start};
+		model -> levels.push_back(level);
+		index << grid << ' ' << level.triangles << ' ' << level.vertices << std::endl;
+	}
+	if (!writeFile(directory + "levels.txt", index.str())) {
+		std::cerr << "ERROR: Could not write to " << directory << std::endl;
+		return true;
+	}
+	return false;
+}
+
+//Moves the bounds of a model through its matrices, in the order they are
+//applied, and returns the largest scale. Returns false for a matrix that
+//is missing or not a translation or scale.
+static bool transformBounds(const std::vector<LodMatrix*>& matrices, float bounds[6], float* scale) {
+	*scale = 1.0f;
+	for (size_t i = 0; i < matrices.size(); ++i) {
+		if (matrices[i] == NULL) {
+			return false;
+		}
+		for (int k = 0; k < 3; ++k) {
+			if (matrices[i] -> type == "Translate") {
+				bounds[k] += matrices[i] -> v[k];
+				bounds[3 + k] += matrices[i] -> v[k];
+			}
+			else if (matrices[i] -> type == "Scale") {
+				float a = bounds[k] * matrices[i] -> v[k], b = bounds[3 + k] * matrices[i] -> v[k];
+				bounds[k] = std::min(a, b);
+				bounds[3 + k] = std::max(a, b);
+			}
+			else {
+				return false;
+			}
+		}
+		if (matrices[i] -> type == "Scale") {
+			*scale *= std::max(std::fabs(matrices[i] -> v[0]), std::max(std::fabs(matrices[i] -> v[1]), std::fabs(matrices[i] -> v[2])));
+		}
+	}
+	return true;
+}
+
+static std::map<std::string, LodMatrix> readMatrices(const std::string& xml) {
+	std::map<std::string, LodMatrix> matrices;
+	for (size_t tag = xml.find("<Matrix "); tag != std::string::npos; tag = xml.find("<Matrix ", tag + 1)) {
+		size_t end = xml.find("</Matrix>", tag);
+		LodMatrix matrix;
+		matrix.type = attribute(xml, tag, "Type");
+		const char* names[3] = {"X", "Y", "Z"};
+		for (int k = 0; k < 3; ++k) {
+			std::string value = element(xml, tag, end, names[k]);
+			matrix.v[k] = value.empty() ? (matrix.type == "Scale" ? 1.0f : 0.0f) : (float)atof(value.c_str());
+		}
+		matrices[attribute(xml, tag, "ID")] = matrix;
+	}
+	return matrices;
+}
+
+//Returns the value following option, or NULL if it was not given.
+static const char* findArgument(int argc, char* argv[], const char* option) {
+	const char* value = NULL;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], option) == 0) {
+			value = argv[i + 1];
+		}
+	}
+	return value;
+}
+
+//Chooses the levels and rewrites the <Path> of every model that can use
+//one. With -path, every frame's eye point is a camera; the levels are
+//chosen for the one nearest to each model. Only rank 0 reports.
+static bool rewriteScene(const ConfigData* data, int argc, char* argv[], int rank, int width, int height, std::string* xml, bool* changed) {
+	size_t camera = xml -> find("<Camera ");
+	if (camera == std::string::npos) {
+		std::cerr << "ERROR: The scene has no camera." << std::endl;
+		return true;
+	}
+	std::vector<CameraFrame> eyes(1);
+	float* eye = eyes[0].eye;
+	std::string eyeID = attribute(*xml, camera, "EyePoint");
+	size_t point = xml -> find("<Point ID=\"" + eyeID + "\"");
+	const char* axes[3] = {"X", "Y", "Z"};
+	for (int k = 0; k < 3; ++k) {
+		eye[k] = point == std::string::npos ? 0.0f : (float)atof(attribute(*xml, point, axes[k]).c_str());
+	}
+	float frameWidth = (float)atof(attribute(*xml, camera, "FrameWidth").c_str());
+	float frameHeight = (float)atof(attribute(*xml, camera, "FrameHeight").c_str());
+	float focalDistance = (float)atof(attribute(*xml, camera, "FocalDistance").c_str());
+	if (point == std::string::npos || frameWidth <= 0.0f || frameHeight <= 0.0f || focalDistance <= 0.0f) {
+		std::cerr << "ERROR: Could not read the camera of the scene." << std::endl;
+		return true;
+	}
+	FrameSet frames;
+	if (!data -> cameraPath.empty()) {
+		if (readCameraPath(data, argc, argv, &frames)) {
+			return true;
+		}
+		eyes = frames.cameras;
+	}
+	//Pixels per unit of length one unit in front of the camera.
+	float density = focalDistance * std::max(width / frameWidth, height / frameHeight);
+	std::map<std::string, LodMatrix> matrices = readMatrices(*xml);
+	if (rank == 0 && data -> lodLevel > 0) {
+		std::cout << "LOD Level: " << data -> lodLevel << "^3" << std::endl;
+	}
+	else if (rank == 0) {
+		std::cout << "LOD Error Bound: " << data -> lodError << " pixels from " << eyes.size()
+			<< (eyes.size() == 1 ? " camera" : " cameras") << std::endl;
+	}
+
+	std::string rewritten;
+	size_t copied = 0;
+	*changed = false;
+	for (size_t tag = xml -> find("<Model "); tag != std::string::npos; tag = xml -> find("<Model ", tag + 1)) {
+		size_t end = xml -> find("</Model>", tag);
+		size_t path = xml -> find("<Path>", tag);
+		if (end == std::string::npos || path == std::string::npos || path > end) {
+			continue;
+		}
+		path += 6;
+		std::string model = element(*xml, tag, end, "Path");
+		std::string text;
+		if (!readFile(model, &text)) {
+			continue;
+		}
+		std::string libraries;
+		std::istringstream lines(text);
+		std::string line;
+		unsigned long long hash = hashBytes(14695981039346656037ULL, text.c_str(), text.size());
+		while (std::getline(lines, line)) {
+			std::istringstream tokens(line);
+			std::string type, name;
+			tokens >> type;
+			while (type == "mtllib" && tokens >> name && readFile(directoryOf(model) + name, &libraries)) {
+				hash = hashBytes(hash, libraries.c_str(), libraries.size());
+			}
+		}
+		char key[20];
+		snprintf(key, sizeof(key), "%016llx", hash);
+		std::string directory = data -> lodCacheDir + "/" + key + "/";
+		LodModel levels;
+		if (buildLevels(model, text, directory, &levels)) {
+			return true;
+		}
+		if (levels.triangles == 0) {
+			continue;
+		}
+
+		std::vector<LodMatrix*> applied;
+		for (size_t apply = xml -> find("<ApplyMatrix ", tag); apply != std::string::npos && apply < end;
+			apply = xml -> find("<ApplyMatrix ", apply + 1)) {
+			std::map<std::string, LodMatrix>::iterator found = matrices.find(attribute(*xml, apply, "ID"));
+			applied.push_back(found == matrices.end() ? NULL : &found -> second);
+		}
+		float bounds[6], scale;
+		memcpy(bounds, levels.bounds, sizeof(bounds));
+		bool known = transformBounds(applied, bounds, &scale);
+		double radius = 0.0, nearest = 0.0;
+		for (int k = 0; k < 3; ++k) {
+			double half = 0.5 * (bounds[3 + k] - bounds[k]);
+			radius += half * half;
+		}
+		radius = std::sqrt(radius);
+		for (size_t e = 0; e < eyes.size(); ++e) {
+			double distance = 0.0;
+			for (int k = 0; k < 3; ++k) {
+				double center = 0.5 * (bounds[k] + bounds[3 + k]) - eyes[e].eye[k];
+				distance += center * center;
+			}
+			distance = std::sqrt(distance) - radius;
+			if (e == 0 || distance < nearest) {
+				nearest = distance;
+			}
+		}
+
+		//The levels are ordered from the coarsest; take the first that fits,
+		//or the one -lodlevel asks for.
+		int chosen = -1;
+		std::vector<double> errors(levels.levels.size(), -1.0);
+		for (size_t i = 0; i < levels.levels.size(); ++i) {
+			if (known && nearest > 0.0) {
+				double cell = meshExtent(levels.bounds) / levels.levels[i].grid;
+				errors[i] = std::sqrt(3.0) * cell * scale * density / nearest;
+			}
+			if (chosen < 0 && (data -> lodLevel > 0 ? levels.levels[i].grid == data -> lodLevel :
+				errors[i] >= 0.0 && errors[i] <= data -> lodError)) {
+				chosen = (int)i;
+			}
+		}
+		if (chosen >= 0) {
+			rewritten.append(*xml, copied, path - copied);
+			rewritten += levelPath(directory, model, levels.levels[chosen].grid);
+			copied = path + model.size();
+			*changed = true;
+		}
+
+		if (rank != 0) {
+			continue;
+		}
+		std::cout << "LOD Model: " << model << std::endl;
+		std::cout << "    Full: " << levels.triangles << " triangles, " << meshBytes(levels.vertices, levels.triangles) / 1024.0 << " KB";
+		if (known && nearest > 0.0) {
+			std::cout << ", " << 2.0 * radius * density / nearest << " pixels across at most";
+		}
+		if (data -> lodLevel > 0 && chosen < 0) {
+			std::cout << ", kept without a " << data -> lodLevel << "^3 level";
+		}
+		else if (data -> lodLevel <= 0 && !known) {
+			std::cout << ", kept for a transform other than Translate or Scale";
+		}
+		else if (data -> lodLevel <= 0 && nearest <= 0.0) {
+			std::cout << ", kept with a camera inside its bounds";
+		}
+		std::cout << std::endl;
+		for (size_t i = 0; i < levels.levels.size(); ++i) {
+			const LodLevel& level = levels.levels[i];
+			std::cout << (chosen == (int)i ? "  * " : "    ") << "Level " << level.grid << "^3: " << level.triangles
+				<< " triangles, " << meshBytes(level.vertices, level.triangles) / 1024.0 << " KB";
+			if (errors[i] >= 0.0) {
+				std::cout << ", " << errors[i] << " pixels";
+			}
+			if (levels.built) {
+				std::cout << ", built in " << level.buildTime * 1000.0 << " ms";
+			}
+			std::cout << std::endl;
+		}
+	}
+	rewritten.append(*xml, copied, std::string::npos);
+	*xml = rewritten;
+	return false;
+}
+
+bool lodArguments(const ConfigData* data, int argc, char* argv[]) {
+	if (data -> lodError <= 0.0f && data -> lodLevel <= 0) {
+		return false;
+	}
+	int configArg = -1;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], "-c") == 0) {
+			configArg = i + 1;
+		}
+	}
+	const char* width = findArgument(argc, argv, "-w");
+	const char* height = findArgument(argc, argv, "-h");
+	std::string xml;
+	if (configArg < 0 || width == NULL || height == NULL || atoi(width) <= 0 || atoi(height) <= 0 ||
+		!readFile(argv[configArg], &xml)) {
+		std::cerr << "ERROR: -lod and -lodlevel require -w, -h and a readable -c <ConfigFile>." << std::endl;
+		return true;
+	}
+	if (mkdir(data -> lodCacheDir.c_str(), 0755) != 0 && errno != EEXIST) {
+		std::cerr << "ERROR: Could not create the LOD cache " << data -> lodCacheDir << " (" << strerror(errno) << ")." << std::endl;
+		return true;
+	}
+
+	//Rank 0 builds the missing levels first; on a shared file system the
+	//other ranks then find them in the cache.
+	int rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	bool changed = false;
+	if (rank == 0 && rewriteScene(data, argc, argv, rank, atoi(width), atoi(height), &xml, &changed)) {
+		return true;
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+	if (rank != 0 && rewriteScene(data, argc, argv, rank, atoi(width), atoi(height), &xml, &changed)) {
+		return true;
+	}
+	if (!changed) {
+		return false;
+	}
+
+	//The rewritten scene is named by its contents; the string lives until
+	//the program exits.
+	static std::string config;
+	char name[32];
+	snprintf(name, sizeof(name), "scene_%016llx.xml", hashBytes(14695981039346656037ULL, xml.c_str(), xml.size()));
+	config = data -> lodCacheDir + "/" + name;
+	if (access(config.c_str(), R_OK) != 0 && !writeFile(config, xml)) {
+		std::cerr << "ERROR: Could not write the scene to " << config << std::endl;
+		return true;
+	}
+	argv[configArg] = &config[0];
+	return false;
+}
@@ -22,6 +22,18 @@ using namespace std;
 #include "RayTrace.h"
 #include "master.h"
 #include "slave.h"
+#include "options.h"
+#include "frames.h"
+#include "server.h"
+#include "trace.h"
+#include "counters.h"
+#include "tune.h"
+#include "order.h"
+#include "checkpoint.h"
+#include "budget.h"
+#include "numa.h"
+#include "tilecache.h"
+#include "lod.h"
 
 int main( int argc, char* argv[] ) 
 {
@@ -33,8 +45,65 @@ int main( int argc, char* argv[] )
 	MPI_Abort(MPI_COMM_WORLD, init_flag);
     }
     
+    //Pull out the extended options before the library sees the arguments.
+    if( parseOptions(&argc, &argv, &data) )
+    {
+        MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+    }
+
+    //Every rank needs the cost map to agree on the block order.
+    if( loadCostMap(&data) )
+    {
+        MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+    }
+
+    //Pin the ranks before anything is loaded, so that every rank's scene
+    //and buffers are first touched on its own node.
+    numaBind(&data);
+
+    //A render server loads its scenes per request instead.
+    if( !data.serverSocket.empty() )
+    {
+        MPI_Comm_rank(MPI_COMM_WORLD, &data.mpi_rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &data.mpi_procs);
+        serverMain(&data);
+        MPI_Finalize();
+        return 0;
+    }
+
+    //Swap in the simplified meshes before anything reads the scene.
+    if( lodArguments(&data, argc, argv) )
+    {
+        MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+    }
+
+    //Fill in the block or cycle size from the tuning cache, or tune it.
+    if( tuneArguments(&data, &argc, &argv) )
+    {
+        MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+    }
+
+    //Read the camera path while the scene arguments are still intact.
+    FrameSet frames;
+    if( !data.cameraPath.empty() && readCameraPath(&data, argc, argv, &frames) )
+    {
+        MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+    }
+
+    //Load the supersampled copy of the scene used to refine blocks, and
+    //hash the scene for the tile cache.
+    if( budgetOpen(&data, argc, argv) || tileCacheOpen(&data, argc, argv) )
+    {
+        MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+    }
+
     //Try to initialize the scene.
+    countersOpen(&data);
+    countersPhase(COUNTER_PHASE_LOAD);
+    double loadStart = MPI_Wtime();
     bool result = initialize(&argc, &argv, &data);
+    double loadTime = MPI_Wtime() - loadStart;
+    countersPhase(COUNTER_PHASE_NONE);
     //Make sure that the initialization was completed.	
     if( result )
     {
@@ -44,6 +113,10 @@ int main( int argc, char* argv[] )
     //Insert the MPI intialization code here.
     MPI_Comm_rank(MPI_COMM_WORLD, &data.mpi_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &data.mpi_procs);
+    if( checkpointCheck(&data, argc, argv) || budgetCheck(&data) || tileCacheCheck(&data) )
+    {
+        MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+    }
 
     if( data.mpi_rank == 0 )
     {
@@ -70,17 +143,42 @@ int main( int argc, char* argv[] )
         //Print out the other properties as well
         std::cout << "Dynamic block size: " << data.dynamicBlockHeight << " x " << data.dynamicBlockWidth << std::endl;
         std::cout << "Cycle Size: " << data.cycleSize << std::endl; 
+        if( data.toneMode != TONE_MODE_NONE )
+        {
+            std::cout << "Tone reproduction: " << data.toneMode << std::endl;
+        }
+        std::cout << "Load Time: " << loadTime << " seconds" << std::endl;
 
         //Start the main processing for the ray tracer.
-        masterMain( &data );
+        if( data.cameraPath.empty() )
+        {
+            traceStart( &data );
+            std::string file = masterMain( &data );
+            traceFinish( &data, file );
+            countersReport( &data, file, shadedPixelCount() );
+        }
+        else
+        {
+            masterFrames( &data, &frames );
+        }
     }
-    else
+    else if( data.cameraPath.empty() )
     {
+        traceStart( &data );
         slaveMain( &data );
+        traceFinish( &data, "" );
+        countersReport( &data, "", shadedPixelCount() );
     }
+    else
+    {
+        slaveFrames( &data, &frames );
+    }
+
+    numaReport(&data);
 
     //Clean up the scene and other data.
     shutdown(&data);
+    budgetClose();
     MPI_Finalize();
 
     return 0;
@@ -15,19 +15,30 @@
 #include <iostream>
 #include <mpi.h>
 #include <cstring>
+#include <algorithm>
 
 #include "RayTrace.h"
 #include "master.h"
 #include "utils.h"
+#include "tone.h"
+#include "frames.h"
+#include "trace.h"
+#include "counters.h"
+#include "rma.h"
+#include "gather.h"
+#include "checkpoint.h"
+#include "budget.h"
+#include "tilecache.h"
 
-void masterMain(ConfigData* data)
+std::string masterMain(ConfigData* data)
 {
     //Depending on the partitioning scheme, different things will happen.
     //You should have a different function for each of the required 
     //schemes that returns some values that you need to handle.
     
-    //Allocate space for the image on the master.
-    float* pixels = new float[3 * data->width * data->height];
+    //Allocate space for the image on the master. It starts out black, so
+    //blocks that are never rendered (-timebudget) have a defined color.
+    float* pixels = new float[3 * data->width * data->height]();
     
     //Execution time will be defined as how long it takes
     //for the given function to execute based on partitioning
@@ -67,7 +78,18 @@ void masterMain(ConfigData* data)
 	    break;
 	case PART_MODE_DYNAMIC:
 	    startTime = MPI_Wtime();
-	    masterDynamicPartition(data, pixels);
+	    if (data->dynamicRMA)
+	    {
+	        dynamicRMAPartition(data, pixels);
+	    }
+	    else if (data->timeBudget > 0.0f)
+	    {
+	        masterBudgetPartition(data, pixels);
+	    }
+	    else
+	    {
+	        masterDynamicPartition(data, pixels);
+	    }
 	    stopTime = MPI_Wtime();
 	    break;		
         default:
@@ -81,22 +103,61 @@ void masterMain(ConfigData* data)
 
     //After this gets done, save the image.
     std::cout << "Image will be saved to: ";
-    std::string file = generateFileName(data);
+    std::string file = frameFileName(data, generateFileName(data));
     std::cout << file << std::endl;
+    double saveStart = MPI_Wtime();
+    countersPhase(COUNTER_PHASE_SAVE);
     savePixels(file, pixels, data);
+    traceEvent("save", saveStart);
+    countersPhase(COUNTER_PHASE_NONE);
+    std::cout << "Save Time: " << MPI_Wtime() - saveStart << " seconds" << std::endl;
 
     //Delete the pixel data.
     delete[] pixels; 
+
+    return file;
+}
+
+void masterFrames(ConfigData* data, const FrameSet* frames)
+{
+    double batchStart = MPI_Wtime();
+    if (data->partitioningMode == PART_MODE_DYNAMIC)
+    {
+        masterDynamicFrames(data, frames);
+    }
+    else
+    {
+        //The static schedules need every rank on the same frame, so the
+        //frames are rendered one after another.
+        for (int frame = 0; frame < frames->size(); ++frame)
+        {
+            std::cout << "Frame: " << frame << std::endl;
+            double loadStart = MPI_Wtime();
+            if (loadFrame(data, frames, frame))
+            {
+                MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+            }
+            std::cout << "Load Time: " << MPI_Wtime() - loadStart << " seconds" << std::endl;
+            masterMain(data);
+        }
+    }
+    double batchTime = MPI_Wtime() - batchStart;
+    reportFrameLoads(data);
+    std::cout << "Frames Rendered: " << frames->size() << std::endl;
+    std::cout << "Batch Time: " << batchTime << " seconds" << std::endl;
+    std::cout << "Frames per Second: " << frames->size() / batchTime << std::endl;
 }
 
 void masterSequential(ConfigData* data, float* pixels)
 {
     //Start the computation time timer.
     double computationStart = MPI_Wtime();
+    countersPhase(COUNTER_PHASE_COMPUTE);
 
     //Render the scene.
     for( int i = 0; i < data->height; ++i )
     {
+        double tileStart = traceNow();
         for( int j = 0; j < data->width; ++j )
         {
             int row = i;
@@ -106,11 +167,15 @@ void masterSequential(ConfigData* data, float* pixels)
             int baseIndex = 3 * ( row * data->width + column );
 
             //Call the function to shade the pixel.
-            shadePixel(&(pixels[baseIndex]),row,j,data);
+            shadeTracedPixel(&(pixels[baseIndex]),row,j,data);
         }
-
+        traceTile(i, 0, 1, data->width, tileStart);
     }
 
+    //Apply the tone reproduction operator, if one was selected.
+    toneMapFrame(data, pixels);
+    countersPhase(COUNTER_PHASE_NONE);
+
     //Stop the comp. timer
     double computationStop = MPI_Wtime();
     double computationTime = computationStop - computationStart;
@@ -145,28 +210,57 @@ void staticCyclesHorizontal(ConfigData* data, float* pixels) {
 	int numPix = getIndex(data, rows_per_proc, 0);
 	int size = numPix + 1;
 	float* p_pixel = new float[size];
+	countersPhase(COUNTER_PHASE_COMPUTE);
 	compStart = MPI_Wtime();
 	int M_row = 0;
 	for (int row = 0; row < max_rows; ++row) {
 		if ((row / data -> cycleSize) % data -> mpi_procs == data -> mpi_rank) {
+			double tileStart = traceNow();
 			for (int col = 0; col < max_columns; ++col) {
 				int baseIdx = getIndex(data, row, col);
-				shadePixel(&(pixels[baseIdx]), row, col, data);
+				shadeTracedPixel(&(pixels[baseIdx]), row, col, data);
 			}
+			traceTile(row, 0, 1, max_columns, tileStart);
 			M_row++;
 		}
 	}
 	compStop = MPI_Wtime();
 	compTime = compStop - compStart;
+	if (data -> toneMode != TONE_MODE_NONE) {
+		double partial[2] = {0.0, 0.0};
+		for (int row = 0; row < max_rows; ++row) {
+			if ((row / data -> cycleSize) % data -> mpi_procs == data -> mpi_rank) {
+				accumulateLogLuminance(data, &(pixels[getIndex(data, row, 0)]), max_columns, partial);
+			}
+		}
+		double reduceStart = traceNow();
+		double logAverage = reduceLogAverageLuminance(partial, MPI_COMM_WORLD);
+		traceEvent("reduce", reduceStart);
+		for (int row = 0; row < max_rows; ++row) {
+			if ((row / data -> cycleSize) % data -> mpi_procs == data -> mpi_rank) {
+				toneMapPixels(data, &(pixels[getIndex(data, row, 0)]), max_columns, logAverage);
+			}
+		}
+	}
+	countersPhase(COUNTER_PHASE_COMMUNICATE);
+	double barrierStart = traceNow();
 	MPI_Barrier(MPI_COMM_WORLD);
+	traceEvent("barrier", barrierStart);
 	int pRow = 0; 
 	int mappedRow = 0;
 	commStart = MPI_Wtime();
-	for (int slave = 1; slave < data -> mpi_procs; slave++) {
+	if (data -> hierarchical) {
+		double gatherStart = traceNow();
+		gatherRegions(data, NULL, pixels, &compTime);
+		traceEvent("gather", gatherStart);
+	}
+	for (int slave = 1; slave < data -> mpi_procs && !data -> hierarchical; slave++) {
 		pRow = slave * data -> cycleSize;
 		mappedRow = 0;
 
-		MPI_Recv(p_pixel, size, MPI_FLOAT, slave, 8, MPI_COMM_WORLD, &status);
+		double recvStart = traceNow();
+		recvPixelPacket(data, p_pixel, size, numPix, slave, 8, &status);
+		traceEvent("recv", recvStart);
 		if (p_pixel[numPix] > compTime) {
 			compTime = p_pixel[numPix];
 		}
@@ -180,6 +274,7 @@ void staticCyclesHorizontal(ConfigData* data, float* pixels) {
 			pRow += (data -> mpi_procs - 1) * data -> cycleSize;
 		}
 	}
+	countersPhase(COUNTER_PHASE_NONE);
 	commStop = MPI_Wtime();
 	commTime = commStop - commStart;
 	std::cout << "Total Computation Time: " << compTime << " seconds" << std::endl;
@@ -208,17 +303,32 @@ void masterStaticStripsVertical(ConfigData* data, float* pixels) {
 		colStart = (colsPerProcessE * colsR) + ((data -> mpi_rank - colsR) * colsPerProcessN);
 	}
 	int colEnd = colStart + colsToCalc;
+	countersPhase(COUNTER_PHASE_COMPUTE);
 	computationStart = MPI_Wtime();
 	float *pixels2 = new float[(3 * data -> width * data -> height)];
+	double tileStart = traceNow();
 	for (int row = 0; row < rowsMax; ++row) {
 		for (int col = colStart; col < colEnd; ++col) {
 			int pBaseIdx = pGetIndex(data, row, col);
-			shadePixel(&(pixels2[pBaseIdx]), row, col, data);
+			shadeTracedPixel(&(pixels2[pBaseIdx]), row, col, data);
 		}
 	}
+	traceTile(0, colStart, rowsMax, colsToCalc, tileStart);
 	computationStop = MPI_Wtime();
 	computationTime = computationStop - computationStart;
+	if (data -> toneMode != TONE_MODE_NONE) {
+		double partial[2] = {0.0, 0.0};
+		float* region = &(pixels2[pGetIndex(data, 0, colStart)]);
+		accumulateLogLuminance(data, region, colsToCalc * rowsMax, partial);
+		double reduceStart = traceNow();
+		double logAverage = reduceLogAverageLuminance(partial, MPI_COMM_WORLD);
+		traceEvent("reduce", reduceStart);
+		toneMapPixels(data, region, colsToCalc * rowsMax, logAverage);
+	}
+	countersPhase(COUNTER_PHASE_COMMUNICATE);
+	double barrierStart = traceNow();
 	MPI_Barrier(MPI_COMM_WORLD);
+	traceEvent("barrier", barrierStart);
 
 	int slave = 1;
 	int baseIdx = pGetIndex(data, 0, colsToCalc);
@@ -228,8 +338,15 @@ void masterStaticStripsVertical(ConfigData* data, float* pixels) {
 	double communicationStart1, communicationStop1, communicationTime1;
 	double communicationStart2, communicationStop2, communicationTime2;
 	communicationStart1 = MPI_Wtime();
-	for (slave = 1; slave < colsR; slave++) {
-		MPI_Recv(packet, size, MPI_FLOAT, slave, 8, MPI_COMM_WORLD, &status);
+	if (data -> hierarchical) {
+		double gatherStart = traceNow();
+		gatherRegions(data, NULL, pixels, &computationTime);
+		traceEvent("gather", gatherStart);
+	}
+	for (slave = 1; slave < colsR && !data -> hierarchical; slave++) {
+		double recvStart = traceNow();
+		recvPixelPacket(data, packet, size, 0, slave, 8, &status);
+		traceEvent("recv", recvStart);
 		if (packet[0] > computationTime) {
 			computationTime = packet[0];
 		}
@@ -241,20 +358,27 @@ void masterStaticStripsVertical(ConfigData* data, float* pixels) {
 	savePix = getIndex(data, colsPerProcessN, 0);
 	size = savePix + 1;
 	communicationStart2 = MPI_Wtime();
-	for (; slave < data -> mpi_procs; slave++) {
-		MPI_Recv(packet, size, MPI_FLOAT, slave, 8, MPI_COMM_WORLD, &status);
+	for (; slave < data -> mpi_procs && !data -> hierarchical; slave++) {
+		double recvStart = traceNow();
+		recvPixelPacket(data, packet, size, 0, slave, 8, &status);
+		traceEvent("recv", recvStart);
 		if (packet[0] > computationTime) {
 			computationTime = packet[0];
 		}
 		memcpy(&(pixels2[baseIdx]), &packet[1], savePix * sizeof(float));
 		baseIdx += savePix;
 	}
+	countersPhase(COUNTER_PHASE_NONE);
 	communicationStop2 = MPI_Wtime();
 	communicationTime2 = communicationStop2 - communicationStart2;
 	double communicationTime;
 	communicationTime = communicationTime1 + communicationTime2;
+	//With the hierarchical gather, only the master's own strip is left
+	//in pixels2.
+	int firstCol = data -> hierarchical ? colStart : 0;
+	int lastCol = data -> hierarchical ? colEnd : data -> width;
 	for(int i = 0; i < data -> height; ++i) {
-		for (int j = 0; j < data -> width; ++j) {
+		for (int j = firstCol; j < lastCol; ++j) {
 			int row = i;
 			int col = j;
 			int baseIdx = getIndex(data, row, col);
@@ -275,22 +399,44 @@ void masterDynamicPartition(ConfigData* data, float *pixels) {
 	DynamicBlock dynamicBlock = DynamicBlock(data);
 	MPI_Status status;
 	double computationStart, computationStop, computationTime;
+	countersPhase(COUNTER_PHASE_COMMUNICATE);
 	computationStart = MPI_Wtime();
 	int size = dynamicBlock.getSize();
-	int numBlocks = dynamicBlock.numBlocksWide * dynamicBlock.numBlocksTall;
 	int packetIndex, pixelIndex, slave, slaveBlockID;
 	float *packet = new float[size];
+
+	//Blocks restored from a checkpoint are left out of the schedule.
+	std::vector<int> schedule;
+	double partial[2] = {0.0, 0.0};
+	if (checkpointOpen(data, &dynamicBlock, pixels, &schedule, partial)) {
+		MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+	}
+	tileCacheLookup(data, &dynamicBlock, pixels, &schedule, partial);
+	int slaves = data -> mpi_procs - 1;
+	int busySlaves = slaves;
 	
 	int blockID;
 	double communicationStart1, communicationStop1, communicationTime1;
 	communicationStart1 = MPI_Wtime();
-	for (blockID = data -> mpi_procs - 1; blockID < numBlocks; ++blockID) {
+	if (masterAssignsFirstBlock(data)) {
+		busySlaves = std::min(slaves, (int)schedule.size());
+		for (int i = 1; i <= slaves; ++i) {
+			blockID = i <= busySlaves ? schedule[i - 1] : -1;
+			MPI_Send(&blockID, 1, MPI_INT, i, MPI_TAG_DYNAMIC, MPI_COMM_WORLD);
+		}
+	}
+	for (int next = slaves; next < (int)schedule.size(); ++next) {
+		blockID = schedule[next];
+		double recvStart = traceNow();
 		MPI_Recv(packet, size, MPI_FLOAT, MPI_ANY_SOURCE, 8, MPI_COMM_WORLD, &status);
+		traceEvent("recv", recvStart);
 		slave = packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_SLAVE];
 		slaveBlockID = packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_BLOCK_ID];
 		dynamicBlock.updateDynamicBlockData(data, slaveBlockID);
+		double sendStart = traceNow();
 		MPI_Send(&blockID, 1, MPI_INT, slave, MPI_TAG_DYNAMIC, MPI_COMM_WORLD);
-		for (int row = 0; row < dynamicBlock.blockRowNum; row++) {
+		traceEvent("send", sendStart);
+		for (int row = 0; row < dynamicBlock.blockRowNum && !data -> hierarchical; row++) {
 			for (int col = 0; col < dynamicBlock.blockColNum; col++) {
 				pixelIndex = getIndex(data, dynamicBlock.blockRowStart + row, dynamicBlock.blockColStart + col);
 				
@@ -300,6 +446,8 @@ void masterDynamicPartition(ConfigData* data, float *pixels) {
 				pixels[pixelIndex + 2] = packet[packetIndex + 2];
 			}
 		}			
+		checkpointBlock(&dynamicBlock, packet);
+		tileCacheStore(data, &dynamicBlock, packet);
 	}
 	communicationStop1 = MPI_Wtime();
 	communicationTime1 = communicationStop1 - communicationStart1;
@@ -307,16 +455,20 @@ void masterDynamicPartition(ConfigData* data, float *pixels) {
 	double communicationStart2, communicationStop2, communicationTime2;
 	communicationStart2 = MPI_Wtime();
 	blockID = -1;
-	for (int i = 1; i < data -> mpi_procs; ++i) {
+	for (int i = 0; i < busySlaves; ++i) {
+		double recvStart = traceNow();
 		MPI_Recv(packet, size, MPI_FLOAT, MPI_ANY_SOURCE, 8, MPI_COMM_WORLD, &status);
+		traceEvent("recv", recvStart);
 		slave = packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_SLAVE];
 		slaveBlockID = packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_BLOCK_ID];
 		if(packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_COMPUTATION_TIME] > computationTime) {
 			computationTime = packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_COMPUTATION_TIME];
 		}
 		dynamicBlock.updateDynamicBlockData(data, slaveBlockID);
+		double sendStart = traceNow();
 		MPI_Send(&blockID, 1, MPI_INT, slave, MPI_TAG_DYNAMIC, MPI_COMM_WORLD);
-		for (int row = 0; row < dynamicBlock.blockRowNum; row++) {
+		traceEvent("send", sendStart);
+		for (int row = 0; row < dynamicBlock.blockRowNum && !data -> hierarchical; row++) {
 			for (int col = 0; col < dynamicBlock.blockColNum; col++) {
 				pixelIndex = getIndex(data, dynamicBlock.blockRowStart + row, dynamicBlock.blockColStart + col);
 				packetIndex = dynamicBlock.getIndex(row, col);
@@ -325,9 +477,31 @@ void masterDynamicPartition(ConfigData* data, float *pixels) {
                                 pixels[pixelIndex + 2] = packet[packetIndex + 2];
 			}
 		}
+		checkpointBlock(&dynamicBlock, packet);
+		tileCacheStore(data, &dynamicBlock, packet);
 	}
+	checkpointClose();
+	tileCacheClose(data);
 	communicationStop2 = MPI_Wtime();
-	communicationTime2 = communicationStop2 = communicationStart2;
+	communicationTime2 = communicationStop2 - communicationStart2;
+	if (data -> hierarchical) {
+		//The slaves kept their blocks; only the schedule went through here.
+		double slaveTime = 0.0;
+		double gatherStart = traceNow();
+		gatherRegions(data, NULL, pixels, &slaveTime);
+		traceEvent("gather", gatherStart);
+	}
+	countersPhase(COUNTER_PHASE_NONE);
+	if (data -> toneMode != TONE_MODE_NONE) {
+		//The slaves hold the log luminance of the blocks they rendered.
+		//Blocks are sent as they finish, before the average is known,
+		//so the operator is applied here once the sums are combined.
+		//The master's sums are those of the blocks it resumed.
+		double reduceStart = traceNow();
+		double logAverage = reduceLogAverageLuminance(partial, MPI_COMM_WORLD);
+		traceEvent("reduce", reduceStart);
+		toneMapPixels(data, pixels, data -> width * data -> height, logAverage);
+	}
 	double communicationTime = communicationTime1 + communicationTime2;
 	computationStop = MPI_Wtime();
 	computationTime = computationStop - computationStart;
@@ -341,33 +515,58 @@ void masterDynamicPartition(ConfigData* data, float *pixels) {
 void masterStaticBlocks(ConfigData *data, float *pixels) {
 	MPI_Status status;
 	double computationStart, computationStop, computationTime;
+	countersPhase(COUNTER_PHASE_COMPUTE);
 	computationStart = MPI_Wtime();
 	StaticBlock staticBlock = StaticBlock(data);
 	if (staticBlock.sqrtProcessors == 0) {
 		std::cout << "Error: " << data -> mpi_procs << " is not a perfect square to implement blocks" << std::endl;
 		return;
 	}
+	double tileStart = traceNow();
 	for (int row = staticBlock.rowStart; row < staticBlock.rowEnd; ++row) {
 		for (int col = staticBlock.colStart; col < staticBlock.colEnd; ++col) {
 			int baseIdx = getIndex(data, row, col);
 
-			shadePixel(&(pixels[baseIdx]), row, col, data);
+			shadeTracedPixel(&(pixels[baseIdx]), row, col, data);
 		}
 	}
+	traceTile(staticBlock.rowStart, staticBlock.colStart, staticBlock.rowsToCalc, staticBlock.colsToCalc, tileStart);
 	computationStop = MPI_Wtime();
 	computationTime = computationStop - computationStart;
+	if (data -> toneMode != TONE_MODE_NONE) {
+		double partial[2] = {0.0, 0.0};
+		for (int row = staticBlock.rowStart; row < staticBlock.rowEnd; ++row) {
+			accumulateLogLuminance(data, &(pixels[getIndex(data, row, staticBlock.colStart)]), staticBlock.colsToCalc, partial);
+		}
+		double reduceStart = traceNow();
+		double logAverage = reduceLogAverageLuminance(partial, MPI_COMM_WORLD);
+		traceEvent("reduce", reduceStart);
+		for (int row = staticBlock.rowStart; row < staticBlock.rowEnd; ++row) {
+			toneMapPixels(data, &(pixels[getIndex(data, row, staticBlock.colStart)]), staticBlock.colsToCalc, logAverage);
+		}
+	}
+	countersPhase(COUNTER_PHASE_COMMUNICATE);
+	double barrierStart = traceNow();
 	MPI_Barrier(MPI_COMM_WORLD);
+	traceEvent("barrier", barrierStart);
 	staticBlock.updateStaticBlockData(data -> mpi_procs - 1);
 	int size = staticBlock.getSize();
 	float *packet = new float[size];
 	int packetIdx, pixelIdx;
 	double communicationStart, communicationStop, communicationTime;
 	communicationStart = MPI_Wtime();
-	for (int slave = 1; slave < data -> mpi_procs; slave++) {
+	if (data -> hierarchical) {
+		double gatherStart = traceNow();
+		gatherRegions(data, NULL, pixels, &computationTime);
+		traceEvent("gather", gatherStart);
+	}
+	for (int slave = 1; slave < data -> mpi_procs && !data -> hierarchical; slave++) {
 		staticBlock.updateStaticBlockData(slave);
 		size = staticBlock.getSize();
 
-		MPI_Recv(packet, size, MPI_FLOAT, slave, 8, MPI_COMM_WORLD, &status);
+		double recvStart = traceNow();
+		recvPixelPacket(data, packet, size, size - 1, slave, 8, &status);
+		traceEvent("recv", recvStart);
 		if (packet[size - 1] > computationTime) {
 			computationTime = packet[size - 1];
 		}
@@ -382,6 +581,7 @@ void masterStaticBlocks(ConfigData *data, float *pixels) {
 		}
 	
 	}
+	countersPhase(COUNTER_PHASE_NONE);
 	communicationStop = MPI_Wtime();
 	communicationTime = communicationStop - communicationStart;
 	std::cout << "Total Computation Time: " << computationTime << " seconds" << std::endl;
@@ -390,3 +590,66 @@ void masterStaticBlocks(ConfigData *data, float *pixels) {
     	std::cout << "C-to-C Ratio: " << c2cRatio << std::endl;
 	delete[] packet;
 }
+
+void masterDynamicFrames(ConfigData* data, const FrameSet* frames) {
+	DynamicBlock dynamicBlock = DynamicBlock(data);
+	MPI_Status status;
+	double batchStart = MPI_Wtime();
+	int size = dynamicBlock.getSize();
+	int numBlocks = dynamicBlock.numBlocksWide * dynamicBlock.numBlocksTall;
+	int numFrames = frames -> size();
+	int totalBlocks = numBlocks * numFrames;
+	int packetIndex, pixelIndex, slave, slaveBlockID, frame;
+	float *packet = new float[size];
+
+	//Block IDs run across all of the frames, so slaves move on to the
+	//next frame while the last blocks of the previous one are in flight.
+	//Each frame is saved as soon as its last block arrives; the master's
+	//camera is only used for writing, so it does not need reloading.
+	float **framePixels = new float*[numFrames]();
+	int *blocksDone = new int[numFrames]();
+	int blockID = std::min(data -> mpi_procs - 1, totalBlocks);
+	double computationTime = 0.0;
+	for (int received = 0; received < totalBlocks; ++received) {
+		MPI_Recv(packet, size, MPI_FLOAT, MPI_ANY_SOURCE, 8, MPI_COMM_WORLD, &status);
+		slave = packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_SLAVE];
+		slaveBlockID = packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_BLOCK_ID];
+		if (packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_COMPUTATION_TIME] > computationTime) {
+			computationTime = packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_COMPUTATION_TIME];
+		}
+		int nextBlockID = blockID < totalBlocks ? blockID++ : -1;
+		MPI_Send(&nextBlockID, 1, MPI_INT, slave, MPI_TAG_DYNAMIC, MPI_COMM_WORLD);
+
+		frame = slaveBlockID / numBlocks;
+		if (framePixels[frame] == NULL) {
+			framePixels[frame] = new float[3 * data -> width * data -> height];
+		}
+		float *pixels = framePixels[frame];
+		dynamicBlock.updateDynamicBlockData(data, slaveBlockID % numBlocks);
+		for (int row = 0; row < dynamicBlock.blockRowNum; row++) {
+			for (int col = 0; col < dynamicBlock.blockColNum; col++) {
+				pixelIndex = getIndex(data, dynamicBlock.blockRowStart + row, dynamicBlock.blockColStart + col);
+				packetIndex = dynamicBlock.getIndex(row, col);
+				pixels[pixelIndex] = packet[packetIndex];
+				pixels[pixelIndex + 1] = packet[packetIndex + 1];
+				pixels[pixelIndex + 2] = packet[packetIndex + 2];
+			}
+		}
+
+		if (++blocksDone[frame] == numBlocks) {
+			//The whole frame is here, so its log average is taken on the
+			//master.
+			toneMapFrame(data, pixels);
+			data -> frameIndex = frame;
+			std::string file = frameFileName(data, generateFileName(data));
+			std::cout << "Frame " << frame << " completed at " << MPI_Wtime() - batchStart << " seconds; saved to: " << file << std::endl;
+			savePixels(file, pixels, data);
+			delete[] pixels;
+			framePixels[frame] = NULL;
+		}
+	}
+	std::cout << "Total Computation Time: " << computationTime << " seconds" << std::endl;
+	delete[] blocksDone;
+	delete[] framePixels;
+	delete[] packet;
+}
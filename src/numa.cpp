@@ -0,0 +1,166 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <sched.h>
+#include <dirent.h>
+#include <mpi.h>
+
+#include "numa.h"
+
+//The node of every core, or -1 for unknown.
+static std::vector<int> coreNodes;
+static int numNodes = 0;
+static int boundCore = -1;
+
+//Parses a sysfs cpu list such as "0-3,8-11".
+static std::vector<int> parseCpuList(const std::string& list) {
+	std::vector<int> cpus;
+	std::istringstream ranges(list);
+	std::string range;
+	while (std::getline(ranges, range, ',')) {
+		int first, last;
+		int fields = sscanf(range.c_str(), "%d-%d", &first, &last);
+		if (fields < 1) {
+			continue;
+		}
+		if (fields == 1) {
+			last = first;
+		}
+		for (int cpu = first; cpu <= last; ++cpu) {
+			cpus.push_back(cpu);
+		}
+	}
+	return cpus;
+}
+
+static void readTopology() {
+	coreNodes.assign(CPU_SETSIZE, -1);
+	numNodes = 0;
+	DIR* nodes = opendir("/sys/devices/system/node");
+	if (nodes != NULL) {
+		struct dirent* entry;
+		while ((entry = readdir(nodes)) != NULL) {
+			int node;
+			char extra;
+			if (sscanf(entry -> d_name, "node%d%c", &node, &extra) != 1) {
+				continue;
+			}
+			std::ifstream in(("/sys/devices/system/node/" + std::string(entry -> d_name) + "/cpulist").c_str());
+			std::string list;
+			std::getline(in, list);
+			std::vector<int> cpus = parseCpuList(list);
+			for (size_t i = 0; i < cpus.size(); ++i) {
+				if (cpus[i] < CPU_SETSIZE) {
+					coreNodes[cpus[i]] = node;
+				}
+			}
+			numNodes = std::max(numNodes, node + 1);
+		}
+		closedir(nodes);
+	}
+	//Without NUMA information every core is on node 0.
+	if (numNodes == 0) {
+		numNodes = 1;
+		coreNodes.assign(CPU_SETSIZE, 0);
+	}
+}
+
+void numaBind(const ConfigData* data) {
+	if (!data -> numa) {
+		return;
+	}
+	readTopology();
+	MPI_Comm nodeComm;
+	MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &nodeComm);
+	int localRank;
+	MPI_Comm_rank(nodeComm, &localRank);
+	MPI_Comm_free(&nodeComm);
+
+	//Only the cores this process may use, grouped by node.
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+	std::vector<std::vector<int> > nodeCores(numNodes);
+	for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		if (CPU_ISSET(cpu, &allowed) && coreNodes[cpu] >= 0) {
+			nodeCores[coreNodes[cpu]].push_back(cpu);
+		}
+	}
+	std::vector<int> usable;
+	for (int node = 0; node < numNodes; ++node) {
+		if (!nodeCores[node].empty()) {
+			usable.push_back(node);
+		}
+	}
+	if (usable.empty()) {
+		return;
+	}
+	const std::vector<int>& cores = nodeCores[usable[localRank % usable.size()]];
+	int core = cores[(localRank / usable.size()) % cores.size()];
+	cpu_set_t pinned;
+	CPU_ZERO(&pinned);
+	CPU_SET(core, &pinned);
+	if (sched_setaffinity(0, sizeof(pinned), &pinned) == 0) {
+		boundCore = core;
+	}
+}
+
+void numaReport(const ConfigData* data) {
+	if (!data -> numa) {
+		return;
+	}
+	//Resident memory per node, in kB.
+	std::vector<double> nodeMemory(numNodes, 0.0);
+	std::ifstream maps("/proc/self/numa_maps");
+	std::string line;
+	while (std::getline(maps, line)) {
+		std::istringstream fields(line);
+		std::string field;
+		double pageSize = 4.0;
+		std::vector<std::pair<int, double> > pages;
+		while (fields >> field) {
+			int node;
+			long count;
+			if (sscanf(field.c_str(), "N%d=%ld", &node, &count) == 2) {
+				pages.push_back(std::make_pair(node, (double)count));
+			}
+			else if (field.compare(0, 18, "kernelpagesize_kB=") == 0) {
+				pageSize = atof(field.c_str() + 18);
+			}
+		}
+		for (size_t i = 0; i < pages.size(); ++i) {
+			if (pages[i].first >= 0 && pages[i].first < numNodes) {
+				nodeMemory[pages[i].first] += pages[i].second * pageSize;
+			}
+		}
+	}
+	int core = boundCore >= 0 ? boundCore : sched_getcpu();
+	int node = core >= 0 && core < CPU_SETSIZE ? coreNodes[core] : -1;
+	double local = 0.0, remote = 0.0;
+	for (int n = 0; n < numNodes; ++n) {
+		if (n == node) {
+			local += nodeMemory[n];
+		}
+		else {
+			remote += nodeMemory[n];
+		}
+	}
+
+	double mine[4] = {(double)core, (double)node, local / 1024.0, remote / 1024.0};
+	std::vector<double> all(data -> mpi_rank == 0 ? 4 * data -> mpi_procs : 0);
+	MPI_Gather(mine, 4, MPI_DOUBLE, all.empty() ? NULL : &all[0], 4, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	if (data -> mpi_rank != 0) {
+		return;
+	}
+	std::cout << "NUMA Nodes: " << numNodes << std::endl;
+	for (int rank = 0; rank < data -> mpi_procs; ++rank) {
+		const double* r = &all[4 * rank];
+		double total = r[2] + r[3];
+		std::cout << "Rank " << rank << ": core " << (int)r[0] << ", node " << (int)r[1] << ", " << r[2] << " MB local, "
+			<< r[3] << " MB remote (" << (total > 0.0 ? 100.0 * r[3] / total : 0.0) << "% remote)" << std::endl;
+	}
+}
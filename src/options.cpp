@@ -0,0 +1,302 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+#include "options.h"
+
+static bool parseFloat(const char* value, float* out) {
+	char* end;
+	*out = strtof(value, &end);
+	return end != value && *end == '\0';
+}
+
+static bool parseInt(const char* value, int* out) {
+	char* end;
+	*out = (int)strtol(value, &end, 10);
+	return end != value && *end == '\0';
+}
+
+static bool parseToneMode(const char* value, ToneType* out) {
+	if (strcmp(value, "none") == 0) {
+		*out = TONE_MODE_NONE;
+	}
+	else if (strcmp(value, "reinhard") == 0) {
+		*out = TONE_MODE_REINHARD;
+	}
+	else if (strcmp(value, "ward") == 0) {
+		*out = TONE_MODE_WARD;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+static bool parseBlockOrder(const char* value, BlockOrderType* out) {
+	if (strcmp(value, "rows") == 0) {
+		*out = BLOCK_ORDER_ROWS;
+	}
+	else if (strcmp(value, "morton") == 0) {
+		*out = BLOCK_ORDER_MORTON;
+	}
+	else if (strcmp(value, "hilbert") == 0) {
+		*out = BLOCK_ORDER_HILBERT;
+	}
+	else if (strcmp(value, "cost") == 0) {
+		*out = BLOCK_ORDER_COST;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+void setDefaultOptions(ConfigData* configuration) {
+	configuration -> toneMode = TONE_MODE_NONE;
+	configuration -> toneKey = 0.18f;
+	configuration -> toneWorldLuminance = 1000.0f;
+	configuration -> toneDisplayLuminance = 100.0f;
+	configuration -> cameraPath = "";
+	configuration -> numFrames = 0;
+	configuration -> frameIndex = -1;
+	configuration -> serverSocket = "";
+	configuration -> sceneCacheSize = 4;
+	configuration -> trace = false;
+	configuration -> counters = false;
+	configuration -> fpEvent = 0;
+	configuration -> autotune = false;
+	configuration -> tuneScale = 0.25f;
+	configuration -> tuneCache = "tuning_cache.txt";
+	configuration -> dynamicRMA = false;
+	configuration -> hierarchical = false;
+	configuration -> blockOrder = BLOCK_ORDER_ROWS;
+	configuration -> costMapFile = "";
+	configuration -> costMap.clear();
+	configuration -> costMapWidth = 0;
+	configuration -> costMapHeight = 0;
+	configuration -> checkpointFile = "";
+	configuration -> checkpointInterval = 60.0f;
+	configuration -> resume = false;
+	configuration -> timeBudget = 0.0f;
+	configuration -> refineSamples = 3;
+	configuration -> numa = false;
+	configuration -> tileCacheDir = "";
+	configuration -> tileCacheSize = 1024;
+	configuration -> lodError = 0.0f;
+	configuration -> lodLevel = 0;
+	configuration -> lodCacheDir = "lod_cache";
+}
+
+bool parseOptions(int* argc, char** argv[], ConfigData* configuration) {
+	setDefaultOptions(configuration);
+
+	char** args = *argv;
+	int kept = 1;
+	for (int i = 1; i < *argc; ++i) {
+		const char* option = args[i];
+		const char* value = (i + 1 < *argc) ? args[i + 1] : NULL;
+		bool valid = true;
+		if (strcmp(option, "-tr") == 0) {
+			valid = value != NULL && parseToneMode(value, &configuration -> toneMode);
+		}
+		else if (strcmp(option, "-trkey") == 0) {
+			valid = value != NULL && parseFloat(value, &configuration -> toneKey);
+		}
+		else if (strcmp(option, "-trlmax") == 0) {
+			valid = value != NULL && parseFloat(value, &configuration -> toneWorldLuminance);
+		}
+		else if (strcmp(option, "-trldmax") == 0) {
+			valid = value != NULL && parseFloat(value, &configuration -> toneDisplayLuminance);
+		}
+		else if (strcmp(option, "-path") == 0) {
+			valid = value != NULL;
+			if (valid) {
+				configuration -> cameraPath = value;
+			}
+		}
+		else if (strcmp(option, "-frames") == 0) {
+			valid = value != NULL && parseInt(value, &configuration -> numFrames) && configuration -> numFrames > 0;
+		}
+		else if (strcmp(option, "-server") == 0) {
+			valid = value != NULL;
+			if (valid) {
+				configuration -> serverSocket = value;
+			}
+		}
+		else if (strcmp(option, "-scenecache") == 0) {
+			valid = value != NULL && parseInt(value, &configuration -> sceneCacheSize) && configuration -> sceneCacheSize > 0;
+		}
+		else if (strcmp(option, "-trace") == 0) {
+			//A flag without a value.
+			configuration -> trace = true;
+			continue;
+		}
+		else if (strcmp(option, "-counters") == 0) {
+			configuration -> counters = true;
+			continue;
+		}
+		else if (strcmp(option, "-fpevent") == 0) {
+			char* end;
+			valid = value != NULL;
+			if (valid) {
+				configuration -> fpEvent = strtoull(value, &end, 0);
+				valid = end != value && *end == '\0' && configuration -> fpEvent != 0;
+			}
+		}
+		else if (strcmp(option, "-autotune") == 0) {
+			configuration -> autotune = true;
+			continue;
+		}
+		else if (strcmp(option, "-tunescale") == 0) {
+			valid = value != NULL && parseFloat(value, &configuration -> tuneScale) && configuration -> tuneScale > 0.0f && configuration -> tuneScale <= 1.0f;
+		}
+		else if (strcmp(option, "-tunecache") == 0) {
+			valid = value != NULL;
+			if (valid) {
+				configuration -> tuneCache = value;
+			}
+		}
+		else if (strcmp(option, "-rma") == 0) {
+			configuration -> dynamicRMA = true;
+			continue;
+		}
+		else if (strcmp(option, "-hier") == 0) {
+			configuration -> hierarchical = true;
+			continue;
+		}
+		else if (strcmp(option, "-order") == 0) {
+			valid = value != NULL && parseBlockOrder(value, &configuration -> blockOrder);
+		}
+		else if (strcmp(option, "-costmap") == 0) {
+			valid = value != NULL;
+			if (valid) {
+				configuration -> costMapFile = value;
+			}
+		}
+		else if (strcmp(option, "-checkpoint") == 0) {
+			valid = value != NULL;
+			if (valid) {
+				configuration -> checkpointFile = value;
+			}
+		}
+		else if (strcmp(option, "-checkpointinterval") == 0) {
+			valid = value != NULL && parseFloat(value, &configuration -> checkpointInterval) && configuration -> checkpointInterval >= 0.0f;
+		}
+		else if (strcmp(option, "-resume") == 0) {
+			configuration -> resume = true;
+			continue;
+		}
+		else if (strcmp(option, "-numa") == 0) {
+			configuration -> numa = true;
+			continue;
+		}
+		else if (strcmp(option, "-tilecache") == 0) {
+			valid = value != NULL;
+			if (valid) {
+				configuration -> tileCacheDir = value;
+			}
+		}
+		else if (strcmp(option, "-tilecachesize") == 0) {
+			valid = value != NULL && parseInt(value, &configuration -> tileCacheSize) && configuration -> tileCacheSize > 0;
+		}
+		else if (strcmp(option, "-lod") == 0) {
+			valid = value != NULL && parseFloat(value, &configuration -> lodError) && configuration -> lodError > 0.0f;
+		}
+		else if (strcmp(option, "-lodlevel") == 0) {
+			valid = value != NULL && parseInt(value, &configuration -> lodLevel) && configuration -> lodLevel > 0;
+		}
+		else if (strcmp(option, "-lodcache") == 0) {
+			valid = value != NULL;
+			if (valid) {
+				configuration -> lodCacheDir = value;
+			}
+		}
+		else if (strcmp(option, "-timebudget") == 0) {
+			valid = value != NULL && parseFloat(value, &configuration -> timeBudget) && configuration -> timeBudget > 0.0f;
+		}
+		else if (strcmp(option, "-refinesamples") == 0) {
+			valid = value != NULL && parseInt(value, &configuration -> refineSamples) && configuration -> refineSamples > 1;
+		}
+		else {
+			//Not one of ours; leave it for initialize().
+			args[kept++] = args[i];
+			continue;
+		}
+		if (!valid) {
+			std::cerr << "ERROR: " << option << " requires a valid value." << std::endl;
+			printOptionsHelp();
+			return true;
+		}
+		++i;
+	}
+	args[kept] = NULL;
+	*argc = kept;
+	if (configuration -> resume && configuration -> checkpointFile.empty()) {
+		std::cerr << "ERROR: -resume requires -checkpoint." << std::endl;
+		printOptionsHelp();
+		return true;
+	}
+	if ((configuration -> trace || configuration -> counters) && !configuration -> cameraPath.empty()) {
+		std::cerr << "ERROR: -trace and -counters cannot be combined with -path." << std::endl;
+		printOptionsHelp();
+		return true;
+	}
+	if (configuration -> lodError > 0.0f && configuration -> lodLevel > 0) {
+		std::cerr << "ERROR: -lod and -lodlevel cannot be combined." << std::endl;
+		printOptionsHelp();
+		return true;
+	}
+	//The frame schedules only use the scheduling master and a plain gather.
+	if ((configuration -> dynamicRMA || configuration -> hierarchical || configuration -> timeBudget > 0.0f) && !configuration -> cameraPath.empty()) {
+		std::cerr << "ERROR: -rma, -hier and -timebudget cannot be combined with -path." << std::endl;
+		printOptionsHelp();
+		return true;
+	}
+	return false;
+}
+
+void printOptionsHelp() {
+	std::cerr << "Extended Options:" << std::endl;
+	std::cerr << "    -tr       The tone reproduction operator: none, reinhard or ward" << std::endl;
+	std::cerr << "    -trkey    The key value used by the Reinhard operator (default 0.18)" << std::endl;
+	std::cerr << "    -trlmax   The maximum world luminance of the scene (default 1000)" << std::endl;
+	std::cerr << "    -trldmax  The maximum luminance of the display (default 100)" << std::endl;
+	std::cerr << "    -path     A camera path file; renders one image per frame in a single job" << std::endl;
+	std::cerr << "    -frames   The number of frames interpolated along -path (default: one per keyframe)" << std::endl;
+	std::cerr << "    -server   Run as a render server listening on the given UNIX socket;" << std::endl;
+	std::cerr << "              -w, -h, -c and -p are then given per request" << std::endl;
+	std::cerr << "    -scenecache  The number of scenes a server keeps loaded (default 4)" << std::endl;
+	std::cerr << "    -trace    Record a per-rank timeline and per-pixel cost map next to the image" << std::endl;
+	std::cerr << "    -counters Count cycles, instructions, cache and branch misses per rank and phase" << std::endl;
+	std::cerr << "    -fpevent  A raw perf event that counts floating point operations on this CPU," << std::endl;
+	std::cerr << "              e.g. 0x3fc7 for FP_ARITH_INST_RETIRED on recent Intel cores" << std::endl;
+	std::cerr << "    -autotune Search for the best -bh/-bw (dynamic) or -cs (static_cycles_horizontal)" << std::endl;
+	std::cerr << "              and store it in the tuning cache; runs that leave them out use the cache" << std::endl;
+	std::cerr << "    -tunescale  The largest calibration resolution as a fraction of the image (default 0.25)" << std::endl;
+	std::cerr << "    -tunecache  The tuning cache file (default tuning_cache.txt)" << std::endl;
+	std::cerr << "    -rma      With -p dynamic, every rank claims blocks from a shared atomic counter" << std::endl;
+	std::cerr << "              and writes them into rank 0's image with one-sided MPI" << std::endl;
+	std::cerr << "    -hier     Gather the image through one leader per node instead of sending" << std::endl;
+	std::cerr << "              every rank's pixels to rank 0 (static modes and -p dynamic)" << std::endl;
+	std::cerr << "    -order    The order of the dynamic blocks: rows, morton, hilbert or cost" << std::endl;
+	std::cerr << "    -costmap  The _cost.bin of an earlier -trace run; -order cost hands out" << std::endl;
+	std::cerr << "              the most expensive blocks first" << std::endl;
+	std::cerr << "    -checkpoint  With -p dynamic, append completed blocks to <file>.tiles and their" << std::endl;
+	std::cerr << "              row-major indices to <file>.manifest while rendering" << std::endl;
+	std::cerr << "    -checkpointinterval  The seconds between checkpoint writes (default 60)" << std::endl;
+	std::cerr << "    -resume   Restore the blocks in the checkpoint and render only the missing ones" << std::endl;
+	std::cerr << "    -timebudget  With -p dynamic, render a one sample preview of every block and refine blocks" << std::endl;
+	std::cerr << "              until this many milliseconds have passed" << std::endl;
+	std::cerr << "    -refinesamples  Refined blocks use n x n supersampling (default 3)" << std::endl;
+	std::cerr << "    -numa     Pin every rank to a core, spreading the ranks of a machine over its" << std::endl;
+	std::cerr << "              NUMA nodes, and report how much of each rank's memory is remote" << std::endl;
+	std::cerr << "    -tilecache  With -p dynamic, reuse blocks rendered before from this directory and" << std::endl;
+	std::cerr << "              store the new ones there" << std::endl;
+	std::cerr << "    -tilecachesize  The size of the tile cache in MB; the least recently used blocks" << std::endl;
+	std::cerr << "              are evicted beyond it (default 1024)" << std::endl;
+	std::cerr << "    -lod      Replace every model by its coarsest simplified level whose error stays" << std::endl;
+	std::cerr << "              within this many pixels from every camera of the scene or -path" << std::endl;
+	std::cerr << "    -lodlevel  Instead, use the level built on this grid (4, 8, ..., 1024) for every" << std::endl;
+	std::cerr << "              model that has one, to compare the render time of each level" << std::endl;
+	std::cerr << "    -lodcache  The directory the simplified levels are kept in (default lod_cache)" << std::endl;
+}
@@ -0,0 +1,117 @@
+#include <iostream>
+#include <cstdio>
+#include <algorithm>
+#include <mpi.h>
+
+#include "order.h"
+
+bool loadCostMap(ConfigData* data) {
+	if (data -> blockOrder != BLOCK_ORDER_COST) {
+		return false;
+	}
+	int rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	int size[2] = {0, 0};
+	if (rank == 0) {
+		FILE* costFile = data -> costMapFile.empty() ? NULL : fopen(data -> costMapFile.c_str(), "rb");
+		if (costFile == NULL) {
+			std::cerr << "ERROR: -order cost needs a readable -costmap, got \"" << data -> costMapFile << "\"." << std::endl;
+		}
+		else {
+			if (fread(size, sizeof(int), 2, costFile) == 2 && size[0] > 0 && size[1] > 0) {
+				data -> costMap.resize((size_t)size[0] * size[1]);
+				if (fread(&data -> costMap[0], sizeof(float), data -> costMap.size(), costFile) != data -> costMap.size()) {
+					size[0] = size[1] = 0;
+				}
+			}
+			else {
+				size[0] = size[1] = 0;
+			}
+			if (size[0] == 0) {
+				std::cerr << "ERROR: " << data -> costMapFile << " is not a cost map." << std::endl;
+			}
+			fclose(costFile);
+		}
+	}
+	MPI_Bcast(size, 2, MPI_INT, 0, MPI_COMM_WORLD);
+	if (size[0] == 0) {
+		return true;
+	}
+	data -> costMapWidth = size[0];
+	data -> costMapHeight = size[1];
+	data -> costMap.resize((size_t)size[0] * size[1]);
+	MPI_Bcast(&data -> costMap[0], data -> costMap.size(), MPI_FLOAT, 0, MPI_COMM_WORLD);
+	return false;
+}
+
+//Interleaves the bits of x and y.
+static unsigned long long mortonCode(unsigned int x, unsigned int y) {
+	unsigned long long code = 0;
+	for (int bit = 0; bit < 32; ++bit) {
+		code |= (unsigned long long)((x >> bit) & 1) << (2 * bit);
+		code |= (unsigned long long)((y >> bit) & 1) << (2 * bit + 1);
+	}
+	return code;
+}
+
+//The distance of (x, y) along the Hilbert curve that fills an n by n
+//square, n a power of two.
+static unsigned long long hilbertCode(unsigned int n, unsigned int x, unsigned int y) {
+	unsigned long long code = 0;
+	for (unsigned int s = n / 2; s > 0; s /= 2) {
+		unsigned int rx = (x & s) > 0;
+		unsigned int ry = (y & s) > 0;
+		code += (unsigned long long)s * s * ((3 * rx) ^ ry);
+		if (ry == 0) {
+			if (rx == 1) {
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return code;
+}
+
+void blockOrder(const ConfigData* data, int blockWidth, int blockHeight, int numBlocksWide, int numBlocksTall, std::vector<int>* order) {
+	order -> clear();
+	if (data -> blockOrder == BLOCK_ORDER_ROWS) {
+		return;
+	}
+	int numBlocks = numBlocksWide * numBlocksTall;
+	std::vector<std::pair<double, int> > keys(numBlocks);
+	if (data -> blockOrder == BLOCK_ORDER_COST) {
+		//The cost map may come from a render of another size; each pixel
+		//takes the cost of the nearest map pixel. The most expensive
+		//blocks sort first.
+		for (int block = 0; block < numBlocks; ++block) {
+			keys[block] = std::make_pair(0.0, block);
+		}
+		for (int row = 0; row < data -> height; ++row) {
+			int mapRow = (int)((long long)row * data -> costMapHeight / data -> height);
+			int blockRow = row / blockHeight;
+			for (int col = 0; col < data -> width; ++col) {
+				int mapCol = (int)((long long)col * data -> costMapWidth / data -> width);
+				keys[blockRow * numBlocksWide + col / blockWidth].first -= data -> costMap[(size_t)mapRow * data -> costMapWidth + mapCol];
+			}
+		}
+	}
+	else {
+		unsigned int n = 1;
+		while (n < (unsigned int)std::max(numBlocksWide, numBlocksTall)) {
+			n *= 2;
+		}
+		for (int block = 0; block < numBlocks; ++block) {
+			unsigned int x = block % numBlocksWide;
+			unsigned int y = block / numBlocksWide;
+			unsigned long long code = data -> blockOrder == BLOCK_ORDER_MORTON ? mortonCode(x, y) : hilbertCode(n, x, y);
+			keys[block] = std::make_pair((double)code, block);
+		}
+	}
+	//Ties keep the row-major order.
+	std::sort(keys.begin(), keys.end());
+	order -> resize(numBlocks);
+	for (int i = 0; i < numBlocks; ++i) {
+		(*order)[i] = keys[i].second;
+	}
+}
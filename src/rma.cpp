@@ -0,0 +1,118 @@
+#include <iostream>
+#include <cstring>
+#include <mpi.h>
+
+#include "rma.h"
+#include "utils.h"
+#include "master.h"
+#include "tone.h"
+#include "trace.h"
+#include "counters.h"
+
+void dynamicRMAPartition(ConfigData* data, float* pixels) {
+	DynamicBlock dynamicBlock = DynamicBlock(data);
+	int numBlocks = dynamicBlock.numBlocksWide * dynamicBlock.numBlocksTall;
+	bool root = data -> mpi_rank == 0;
+
+	//The windows are allocated by MPI, which every one-sided transport
+	//supports. The counter is zeroed before anyone can reach it.
+	int* nextBlock;
+	float* frame;
+	MPI_Win counterWindow, frameWindow;
+	MPI_Win_allocate(root ? sizeof(int) : 0, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &nextBlock, &counterWindow);
+	MPI_Aint frameSize = root ? 3 * (MPI_Aint)data -> width * data -> height * sizeof(float) : 0;
+	MPI_Win_allocate(frameSize, sizeof(float), MPI_INFO_NULL, MPI_COMM_WORLD, &frame, &frameWindow);
+	if (root) {
+		*nextBlock = 0;
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, counterWindow);
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, frameWindow);
+
+	dynamicBlock.updateDynamicBlockData(data, 0);
+	float* packet = new float[dynamicBlock.getSize()];
+	double computationStart, computationTime = 0.0;
+	double communicationStart, communicationTime = 0.0;
+	double partial[2] = {0.0, 0.0};
+	const int one = 1;
+	int blocks = 0;
+	while (true) {
+		countersPhase(COUNTER_PHASE_COMMUNICATE);
+		communicationStart = MPI_Wtime();
+		int blockID;
+		MPI_Fetch_and_op(&one, &blockID, MPI_INT, 0, 0, MPI_SUM, counterWindow);
+		MPI_Win_flush(0, counterWindow);
+		communicationTime += MPI_Wtime() - communicationStart;
+		traceEvent("fetch", communicationStart);
+		if (blockID >= numBlocks) {
+			break;
+		}
+
+		countersPhase(COUNTER_PHASE_COMPUTE);
+		dynamicBlock.updateDynamicBlockData(data, blockID);
+		computationStart = MPI_Wtime();
+		for (int row = 0; row < dynamicBlock.blockRowNum; ++row) {
+			for (int col = 0; col < dynamicBlock.blockColNum; ++col) {
+				int baseIdx = dynamicBlock.getIndex(row, col);
+				shadeTracedPixel(&(packet[baseIdx]), row + dynamicBlock.blockRowStart, col + dynamicBlock.blockColStart, data);
+			}
+		}
+		traceTile(dynamicBlock.blockRowStart, dynamicBlock.blockColStart, dynamicBlock.blockRowNum, dynamicBlock.blockColNum, computationStart);
+		computationTime += MPI_Wtime() - computationStart;
+		if (data -> toneMode != TONE_MODE_NONE) {
+			accumulateLogLuminance(data, &(packet[DynamicBlock::DYNAMIC_PACKET_MAX]), dynamicBlock.blockRowNum * dynamicBlock.blockColNum, partial);
+		}
+
+		//The block's rows are strided in the frame, so a vector type puts
+		//the whole block at once. The put has to complete before the
+		//packet is reused.
+		countersPhase(COUNTER_PHASE_COMMUNICATE);
+		communicationStart = MPI_Wtime();
+		MPI_Datatype blockType;
+		MPI_Type_vector(dynamicBlock.blockRowNum, 3 * dynamicBlock.blockColNum, 3 * data -> width, MPI_FLOAT, &blockType);
+		MPI_Type_commit(&blockType);
+		MPI_Put(&(packet[DynamicBlock::DYNAMIC_PACKET_MAX]), dynamicBlock.getNumOfPixels(), MPI_FLOAT, 0,
+			getIndex(data, dynamicBlock.blockRowStart, dynamicBlock.blockColStart), 1, blockType, frameWindow);
+		MPI_Win_flush(0, frameWindow);
+		MPI_Type_free(&blockType);
+		communicationTime += MPI_Wtime() - communicationStart;
+		traceEvent("put", communicationStart);
+		++blocks;
+	}
+
+	double barrierStart = traceNow();
+	MPI_Win_unlock_all(frameWindow);
+	MPI_Win_unlock_all(counterWindow);
+	MPI_Barrier(MPI_COMM_WORLD);
+	traceEvent("barrier", barrierStart);
+	if (root) {
+		memcpy(pixels, frame, frameSize);
+	}
+	MPI_Win_free(&frameWindow);
+	MPI_Win_free(&counterWindow);
+
+	if (data -> toneMode != TONE_MODE_NONE) {
+		double reduceStart = traceNow();
+		double logAverage = reduceLogAverageLuminance(partial, MPI_COMM_WORLD);
+		traceEvent("reduce", reduceStart);
+		if (root) {
+			toneMapPixels(data, pixels, data -> width * data -> height, logAverage);
+		}
+	}
+	countersPhase(COUNTER_PHASE_NONE);
+
+	double times[2] = {computationTime, communicationTime};
+	double maxTimes[2];
+	int blockRange[2] = {-blocks, blocks};
+	int maxBlockRange[2];
+	MPI_Reduce(times, maxTimes, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+	MPI_Reduce(blockRange, maxBlockRange, 2, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
+	if (root) {
+		std::cout << "Blocks per Rank: " << -maxBlockRange[0] << " to " << maxBlockRange[1] << std::endl;
+		std::cout << "Total Computation Time: " << maxTimes[0] << " seconds" << std::endl;
+		std::cout << "Total Communication Time: " << maxTimes[1] << " seconds" << std::endl;
+		double c2cRatio = maxTimes[1] / maxTimes[0];
+		std::cout << "C-to-C Ratio: " << c2cRatio << std::endl;
+	}
+	delete[] packet;
+}
@@ -0,0 +1,432 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <list>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <mpi.h>
+
+#include "server.h"
+#include "options.h"
+#include "frames.h"
+#include "master.h"
+#include "slave.h"
+#include "utils.h"
+
+//Requests are cut off at this many characters.
+static const int MAX_REQUEST = 4096;
+//A client that sends nothing or reads nothing for this many seconds is
+//dropped, so it cannot stall the ranks waiting for the next job.
+static const int CLIENT_TIMEOUT = 10;
+
+typedef struct RenderRequest {
+	std::string scene;
+	std::string cameraText;
+	int width, height;
+	PartType mode;
+	int blockWidth, blockHeight, cycleSize;
+	bool hasCamera;
+	CameraFrame camera;
+	bool replyBytes;
+	bool quit;
+} RenderRequest;
+
+typedef struct CachedScene {
+	std::string key;
+	ConfigData* data;
+} CachedScene;
+
+static bool parsePartitionMode(const std::string& value, PartType* mode) {
+	if (value == "none") {
+		*mode = PART_MODE_NONE;
+	}
+	else if (value == "static_strips_vertical") {
+		*mode = PART_MODE_STATIC_STRIPS_VERTICAL;
+	}
+	else if (value == "static_cycles_horizontal") {
+		*mode = PART_MODE_STATIC_CYCLES_HORIZONTAL;
+	}
+	else if (value == "static_blocks") {
+		*mode = PART_MODE_STATIC_BLOCKS;
+	}
+	else if (value == "dynamic") {
+		*mode = PART_MODE_DYNAMIC;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+static bool parseCamera(const std::string& value, CameraFrame* camera) {
+	float v[9];
+	std::string text = value;
+	for (size_t i = 0; i < text.size(); ++i) {
+		if (text[i] == ',') {
+			text[i] = ' ';
+		}
+	}
+	std::istringstream in(text);
+	for (int i = 0; i < 9; ++i) {
+		if (!(in >> v[i])) {
+			return false;
+		}
+	}
+	memcpy(camera -> eye, &v[0], sizeof(camera -> eye));
+	memcpy(camera -> lookAt, &v[3], sizeof(camera -> lookAt));
+	memcpy(camera -> up, &v[6], sizeof(camera -> up));
+	return true;
+}
+
+//Every rank parses the same line, so every rank reaches the same answer.
+static bool parseRequest(const ConfigData* data, const std::string& line, RenderRequest* request, std::string* error) {
+	request -> width = request -> height = 0;
+	request -> mode = PART_MODE_NONE;
+	request -> blockWidth = request -> blockHeight = request -> cycleSize = 0;
+	request -> hasCamera = false;
+	request -> replyBytes = false;
+	request -> quit = line == "quit";
+	if (request -> quit) {
+		return true;
+	}
+
+	std::istringstream in(line);
+	std::string token;
+	while (in >> token) {
+		size_t eq = token.find('=');
+		if (eq == std::string::npos) {
+			*error = "expected key=value, got " + token;
+			return false;
+		}
+		std::string key = token.substr(0, eq);
+		std::string value = token.substr(eq + 1);
+		if (key == "scene") {
+			request -> scene = value;
+		}
+		else if (key == "width") {
+			request -> width = atoi(value.c_str());
+		}
+		else if (key == "height") {
+			request -> height = atoi(value.c_str());
+		}
+		else if (key == "mode") {
+			if (!parsePartitionMode(value, &request -> mode)) {
+				*error = "unsupported mode " + value;
+				return false;
+			}
+		}
+		else if (key == "bw") {
+			request -> blockWidth = atoi(value.c_str());
+		}
+		else if (key == "bh") {
+			request -> blockHeight = atoi(value.c_str());
+		}
+		else if (key == "cs") {
+			request -> cycleSize = atoi(value.c_str());
+		}
+		else if (key == "camera") {
+			request -> hasCamera = parseCamera(value, &request -> camera);
+			request -> cameraText = value;
+			if (!request -> hasCamera) {
+				*error = "camera needs 9 comma separated values";
+				return false;
+			}
+		}
+		else if (key == "reply") {
+			request -> replyBytes = value == "bytes";
+		}
+		else {
+			*error = "unknown key " + key;
+			return false;
+		}
+	}
+
+	if (request -> scene.empty() || request -> width <= 0 || request -> height <= 0) {
+		*error = "scene, width and height are required";
+		return false;
+	}
+	//The library does not survive a scene file it cannot open.
+	if (access(request -> scene.c_str(), R_OK) != 0) {
+		*error = "cannot read " + request -> scene;
+		return false;
+	}
+	if (request -> mode == PART_MODE_DYNAMIC && (request -> blockWidth <= 0 || request -> blockHeight <= 0)) {
+		*error = "dynamic needs bh and bw";
+		return false;
+	}
+	if (request -> mode == PART_MODE_STATIC_CYCLES_HORIZONTAL && request -> cycleSize <= 0) {
+		*error = "static_cycles_horizontal needs cs";
+		return false;
+	}
+	if (request -> mode == PART_MODE_STATIC_BLOCKS && isPerfectSquare(data -> mpi_procs) == 0) {
+		*error = "static_blocks needs a perfect square number of processes";
+		return false;
+	}
+	return true;
+}
+
+//The camera and view plane are built by initialize(), so a scene can only
+//be reused for the same file, image size and camera.
+static std::string sceneKey(const RenderRequest& request) {
+	std::ostringstream key;
+	key << request.scene << "|" << request.width << "x" << request.height << "|" << request.cameraText;
+	return key.str();
+}
+
+static ConfigData* loadScene(const ConfigData* data, const RenderRequest& request) {
+	ConfigData* scene = new ConfigData;
+	setDefaultOptions(scene);
+	scene -> mpi_rank = data -> mpi_rank;
+	scene -> mpi_procs = data -> mpi_procs;
+
+	//The partitioning values are filled in per job, so every scene is
+	//initialized as a sequential one.
+	std::ostringstream width, height;
+	width << request.width;
+	height << request.height;
+	FrameSet frames;
+	const char* args[] = {"raytrace_mpi", "-w", "", "-h", "", "-c", "", "-p", "none"};
+	frames.args.assign(args, args + 9);
+	frames.args[2] = width.str();
+	frames.args[4] = height.str();
+	frames.configArg = 6;
+	frames.args[frames.configArg] = request.scene;
+	frames.config = request.scene;
+	int frame = -1;
+	if (request.hasCamera) {
+		frames.cameras.push_back(request.camera);
+		frame = 0;
+	}
+
+	int failed = initializeFrame(scene, &frames, frame) ? 1 : 0;
+	int anyFailed;
+	MPI_Allreduce(&failed, &anyFailed, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+	if (anyFailed) {
+		if (!failed) {
+			shutdown(scene);
+		}
+		delete scene;
+		return NULL;
+	}
+	scene -> frameIndex = -1;
+	return scene;
+}
+
+static ConfigData* findScene(const ConfigData* data, std::list<CachedScene>& cache, const RenderRequest& request, bool* hit) {
+	std::string key = sceneKey(request);
+	for (std::list<CachedScene>::iterator it = cache.begin(); it != cache.end(); ++it) {
+		if (it -> key == key) {
+			cache.splice(cache.begin(), cache, it);
+			*hit = true;
+			return cache.front().data;
+		}
+	}
+	*hit = false;
+	ConfigData* scene = loadScene(data, request);
+	if (scene == NULL) {
+		return NULL;
+	}
+	CachedScene entry;
+	entry.key = key;
+	entry.data = scene;
+	cache.push_front(entry);
+	if ((int)cache.size() > data -> sceneCacheSize) {
+		shutdown(cache.back().data);
+		delete cache.back().data;
+		cache.pop_back();
+	}
+	return scene;
+}
+
+static int openServerSocket(const std::string& path) {
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		close(fd);
+		return -1;
+	}
+	strcpy(address.sun_path, path.c_str());
+	unlink(path.c_str());
+	if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 16) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+//Returns false if the client timed out before the end of the line.
+static bool readRequest(int client, std::string* line) {
+	char c;
+	while ((int)line -> size() <= MAX_REQUEST) {
+		ssize_t count = read(client, &c, 1);
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return false;
+		}
+		if (count != 1 || c == '\n') {
+			break;
+		}
+		if (c != '\r') {
+			*line += c;
+		}
+	}
+	return true;
+}
+
+//Returns false if the client has gone away or stopped reading.
+static bool writeAll(int fd, const char* buffer, size_t size) {
+	while (size > 0) {
+		ssize_t written = write(fd, buffer, size);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			return false;
+		}
+		buffer += written;
+		size -= written;
+	}
+	return true;
+}
+
+static bool reply(int client, const std::string& text) {
+	return writeAll(client, text.c_str(), text.size());
+}
+
+//Rank 0 reads the next request and hands it to everyone else. Clients
+//that time out are dropped without a job.
+static std::string nextRequest(const ConfigData* data, int server, int* client) {
+	std::string line;
+	if (data -> mpi_rank == 0) {
+		while (true) {
+			line.clear();
+			*client = accept(server, NULL, NULL);
+			if (*client < 0) {
+				break;
+			}
+			struct timeval timeout = {CLIENT_TIMEOUT, 0};
+			setsockopt(*client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			setsockopt(*client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+			if (readRequest(*client, &line)) {
+				break;
+			}
+			std::cerr << "WARNING: Dropped a client that sent no request within " << CLIENT_TIMEOUT << " seconds." << std::endl;
+			close(*client);
+		}
+	}
+	int length = line.size();
+	MPI_Bcast(&length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	line.resize(length);
+	if (length > 0) {
+		MPI_Bcast(&line[0], length, MPI_CHAR, 0, MPI_COMM_WORLD);
+	}
+	return line;
+}
+
+void serverMain(ConfigData* data) {
+	int server = -1;
+	int client = -1;
+	if (data -> mpi_rank == 0) {
+		//A client that disconnects before its reply must not kill rank 0,
+		//and with it the whole pool.
+		signal(SIGPIPE, SIG_IGN);
+		server = openServerSocket(data -> serverSocket);
+		if (server < 0) {
+			std::cerr << "Could not listen on " << data -> serverSocket << std::endl;
+			MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+		}
+		std::cout << "Render server listening on " << data -> serverSocket << " with " << data -> mpi_procs << " processes" << std::endl;
+	}
+
+	std::list<CachedScene> cache;
+	int jobs = 0, hits = 0;
+	while (true) {
+		std::string line = nextRequest(data, server, &client);
+		RenderRequest request;
+		std::string error;
+		bool valid = !line.empty() && parseRequest(data, line, &request, &error);
+		if (valid && request.quit) {
+			if (data -> mpi_rank == 0) {
+				reply(client, "OK quit\n");
+				close(client);
+			}
+			break;
+		}
+
+		double jobStart = MPI_Wtime();
+		ConfigData* scene = NULL;
+		bool hit = false;
+		if (valid) {
+			scene = findScene(data, cache, request, &hit);
+			if (scene == NULL) {
+				error = "could not load " + request.scene;
+			}
+		}
+
+		std::string file;
+		if (scene != NULL) {
+			ConfigData job = *scene;
+			job.partitioningMode = request.mode;
+			job.dynamicBlockWidth = request.blockWidth;
+			job.dynamicBlockHeight = request.blockHeight;
+			job.cycleSize = request.cycleSize;
+			if (data -> mpi_rank == 0) {
+				std::cout << "Job " << jobs << ": " << line << (hit ? " (scene cached)" : "") << std::endl;
+				file = masterMain(&job);
+			}
+			else {
+				slaveMain(&job);
+			}
+			++jobs;
+			hits += hit ? 1 : 0;
+		}
+
+		if (data -> mpi_rank == 0) {
+			if (scene == NULL) {
+				reply(client, "ERROR " + (line.empty() ? std::string("empty request") : error) + "\n");
+			}
+			else {
+				std::ostringstream header;
+				header << "OK " << file << " " << MPI_Wtime() - jobStart;
+				std::string image;
+				if (request.replyBytes) {
+					std::ifstream in(file.c_str(), std::ios::binary);
+					std::stringstream buffer;
+					buffer << in.rdbuf();
+					image = buffer.str();
+					header << " " << image.size();
+				}
+				header << "\n";
+				if (!reply(client, header.str()) || !writeAll(client, image.data(), image.size())) {
+					std::cerr << "WARNING: The client of job " << jobs - 1 << " went away before its reply was sent." << std::endl;
+				}
+			}
+			close(client);
+		}
+	}
+
+	if (data -> mpi_rank == 0) {
+		std::cout << "Jobs: " << jobs << ", scene cache hits: " << hits << std::endl;
+		close(server);
+		unlink(data -> serverSocket.c_str());
+	}
+	while (!cache.empty()) {
+		shutdown(cache.front().data);
+		delete cache.front().data;
+		cache.pop_front();
+	}
+}
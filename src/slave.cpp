@@ -2,11 +2,19 @@
 
 #include <iostream>
 #include <cstring>
+#include <vector>
 #include <mpi.h>
 #include "RayTrace.h"
 #include "slave.h"
 #include "utils.h"
 #include "master.h"
+#include "tone.h"
+#include "frames.h"
+#include "trace.h"
+#include "counters.h"
+#include "rma.h"
+#include "gather.h"
+#include "budget.h"
 
 void slaveMain(ConfigData* data)
 {
@@ -28,7 +36,18 @@ void slaveMain(ConfigData* data)
 	    slaveStaticBlocks(data);
 	    break;
 	case PART_MODE_DYNAMIC:
-	    slaveDynamicPartition(data);
+	    if (data->dynamicRMA)
+	    {
+	        dynamicRMAPartition(data, NULL);
+	    }
+	    else if (data->timeBudget > 0.0f)
+	    {
+	        slaveBudgetPartition(data);
+	    }
+	    else
+	    {
+	        slaveDynamicPartition(data);
+	    }
 	    break;
         default:
             std::cout << "This mode (" << data->partitioningMode;
@@ -37,6 +56,25 @@ void slaveMain(ConfigData* data)
     }
 }
 
+void slaveFrames(ConfigData* data, const FrameSet* frames)
+{
+    if (data->partitioningMode == PART_MODE_DYNAMIC)
+    {
+        slaveDynamicFrames(data, frames);
+    }
+    else
+    {
+        for (int frame = 0; frame < frames->size(); ++frame)
+        {
+            if (loadFrame(data, frames, frame))
+            {
+                MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+            }
+            slaveMain(data);
+        }
+    }
+    reportFrameLoads(data);
+}
 
 void staticCyclesHorizontal(ConfigData* data) {
 	double computationStart, computationStop, computationTime;
@@ -47,28 +85,60 @@ void staticCyclesHorizontal(ConfigData* data) {
 	int numPix = getIndex(data, rows_per_proc, 0);
 	int size = numPix + 1;
 	float *pixels = new float[size];
+	countersPhase(COUNTER_PHASE_COMPUTE);
 	computationStart = MPI_Wtime();
 
 	int M_row = 0;
 	for (int row = 0; row < max_rows; ++row) {
 		if ((row / data -> cycleSize) % data -> mpi_procs == data -> mpi_rank) {
+			double tileStart = traceNow();
 			for (int col = 0; col < max_columns; ++col) {
 				int baseIdx = getIndex(data, M_row, col);
-				shadePixel(&(pixels[baseIdx]), row, col, data);
+				shadeTracedPixel(&(pixels[baseIdx]), row, col, data);
 			}
+			traceTile(row, 0, 1, max_columns, tileStart);
 			M_row++;
 		}
 	}
 	computationStop = MPI_Wtime();
 	computationTime = computationStop - computationStart;
+	if (data -> toneMode != TONE_MODE_NONE) {
+		double partial[2] = {0.0, 0.0};
+		accumulateLogLuminance(data, pixels, M_row * max_columns, partial);
+		double reduceStart = traceNow();
+		double logAverage = reduceLogAverageLuminance(partial, MPI_COMM_WORLD);
+		traceEvent("reduce", reduceStart);
+		toneMapPixels(data, pixels, M_row * max_columns, logAverage);
+	}
+	countersPhase(COUNTER_PHASE_COMMUNICATE);
+	double barrierStart = traceNow();
 	MPI_Barrier(MPI_COMM_WORLD);
-	pixels[numPix] = computationTime;	
-	MPI_Send(pixels, size, MPI_FLOAT, 0, 8, MPI_COMM_WORLD);
+	traceEvent("barrier", barrierStart);
+	if (data -> hierarchical) {
+		PackedRegions regions;
+		int localRow = 0;
+		for (int row = 0; row < max_rows; ++row) {
+			if ((row / data -> cycleSize) % data -> mpi_procs == data -> mpi_rank) {
+				regions.add(row, 0, 1, max_columns, &(pixels[getIndex(data, localRow++, 0)]));
+			}
+		}
+		double gatherStart = traceNow();
+		gatherRegions(data, &regions, NULL, &computationTime);
+		traceEvent("gather", gatherStart);
+	}
+	else {
+		pixels[numPix] = computationTime;	
+		double sendStart = traceNow();
+		sendPixelPacket(data, pixels, size, numPix, 0, 8);
+		traceEvent("send", sendStart);
+	}
+	countersPhase(COUNTER_PHASE_NONE);
 	delete[] pixels;
 }
 
 void slaveStaticStripsVertical(ConfigData* data) {
 	double computationStart, computationStop, computationTime;
+	countersPhase(COUNTER_PHASE_COMPUTE);
 	computationStart = MPI_Wtime();
 	int rowsMax = data -> height;
 	int colsMax = data -> width;
@@ -86,21 +156,53 @@ void slaveStaticStripsVertical(ConfigData* data) {
 	}
 	float *pixels = new float[pGetIndex(data, 0, colsToCalc + 1)];
 
+	double tileStart = traceNow();
 	for (int row = 0; row < rowsMax; ++row) {
 		for (int col = 0; col < colsToCalc; ++col) {
 			int pBaseIdx = pGetIndex(data, row, col);
-			shadePixel(&(pixels[pBaseIdx]), row, col + colStart, data);
+			shadeTracedPixel(&(pixels[pBaseIdx]), row, col + colStart, data);
 		}
 	}
+	traceTile(0, colStart, rowsMax, colsToCalc, tileStart);
 	computationStop = MPI_Wtime();
 	computationTime = computationStop - computationStart;
+	if (data -> toneMode != TONE_MODE_NONE) {
+		double partial[2] = {0.0, 0.0};
+		accumulateLogLuminance(data, pixels, colsToCalc * rowsMax, partial);
+		double reduceStart = traceNow();
+		double logAverage = reduceLogAverageLuminance(partial, MPI_COMM_WORLD);
+		traceEvent("reduce", reduceStart);
+		toneMapPixels(data, pixels, colsToCalc * rowsMax, logAverage);
+	}
 	int savePix = pGetIndex(data, 0, colsToCalc);
 	int size = savePix + 1;
 	float *packet = new float[savePix + 1];
 	packet[0] = computationTime;
 	memcpy(&packet[1], pixels, savePix * sizeof(float));
+	countersPhase(COUNTER_PHASE_COMMUNICATE);
+	double barrierStart = traceNow();
 	MPI_Barrier(MPI_COMM_WORLD);
-	MPI_Send(packet, size, MPI_FLOAT, 0, 8, MPI_COMM_WORLD);
+	traceEvent("barrier", barrierStart);
+	if (data -> hierarchical) {
+		//The strip is stored by column; regions are row-major.
+		std::vector<float> strip(3 * rowsMax * colsToCalc);
+		for (int row = 0; row < rowsMax; ++row) {
+			for (int col = 0; col < colsToCalc; ++col) {
+				memcpy(&strip[3 * (row * colsToCalc + col)], &(pixels[pGetIndex(data, row, col)]), 3 * sizeof(float));
+			}
+		}
+		PackedRegions regions;
+		regions.add(0, colStart, rowsMax, colsToCalc, &strip[0]);
+		double gatherStart = traceNow();
+		gatherRegions(data, &regions, NULL, &computationTime);
+		traceEvent("gather", gatherStart);
+	}
+	else {
+		double sendStart = traceNow();
+		sendPixelPacket(data, packet, size, 0, 0, 8);
+		traceEvent("send", sendStart);
+	}
+	countersPhase(COUNTER_PHASE_NONE);
 	delete[] packet;
 	delete[] pixels;
 }
@@ -115,45 +217,148 @@ void slaveDynamicPartition(ConfigData* data) {
 	
 	double computationStart, computationStop, computationTime;
 	computationTime = 0.0;
+	double partial[2] = {0.0, 0.0};
+	//With the hierarchical gather, blocks stay here until the end and
+	//only the packet header goes to the master.
+	PackedRegions regions;
+	int sendSize = data -> hierarchical ? (int)DynamicBlock::DYNAMIC_PACKET_MAX : size;
+	if (masterAssignsFirstBlock(data)) {
+		MPI_Recv(&blockID, 1, MPI_INT, 0, MPI_TAG_DYNAMIC, MPI_COMM_WORLD, &status);
+	}
 	
 	while (blockID != -1) {
 		dynamicBlock.updateDynamicBlockData(data, blockID);
+		countersPhase(COUNTER_PHASE_COMPUTE);
 		computationStart = MPI_Wtime();
 		for(int row = 0; row < dynamicBlock.blockRowNum; ++row) {
 			for (int col = 0; col < dynamicBlock.blockColNum; ++col) {
 				int baseIdx = dynamicBlock.getIndex(row, col);
-				shadePixel(&(packet[baseIdx]), row + dynamicBlock.blockRowStart, col + dynamicBlock.blockColStart, data);
+				shadeTracedPixel(&(packet[baseIdx]), row + dynamicBlock.blockRowStart, col + dynamicBlock.blockColStart, data);
 			}
 		}
 		computationStop = MPI_Wtime();
+		traceTile(dynamicBlock.blockRowStart, dynamicBlock.blockColStart, dynamicBlock.blockRowNum, dynamicBlock.blockColNum, computationStart);
 		computationTime += computationStop - computationStart;
+		if (data -> toneMode != TONE_MODE_NONE) {
+			accumulateLogLuminance(data, &(packet[DynamicBlock::DYNAMIC_PACKET_MAX]), dynamicBlock.blockRowNum * dynamicBlock.blockColNum, partial);
+		}
 		packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_BLOCK_ID] = blockID;
 		packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_SLAVE] = data -> mpi_rank;
 		packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_COMPUTATION_TIME] = computationTime;
+		if (data -> hierarchical) {
+			regions.add(dynamicBlock.blockRowStart, dynamicBlock.blockColStart, dynamicBlock.blockRowNum, dynamicBlock.blockColNum, &(packet[DynamicBlock::DYNAMIC_PACKET_MAX]));
+		}
 		
-		MPI_Send(packet, size, MPI_FLOAT, 0, 8, MPI_COMM_WORLD);
+		countersPhase(COUNTER_PHASE_COMMUNICATE);
+		double sendStart = traceNow();
+		MPI_Send(packet, sendSize, MPI_FLOAT, 0, 8, MPI_COMM_WORLD);
+		traceEvent("send", sendStart);
 
+		double recvStart = traceNow();
 		MPI_Recv(&blockID, 1, MPI_INT, 0, MPI_TAG_DYNAMIC, MPI_COMM_WORLD, &status);
+		traceEvent("recv", recvStart);
 	}	
+	if (data -> hierarchical) {
+		double gatherStart = traceNow();
+		gatherRegions(data, &regions, NULL, &computationTime);
+		traceEvent("gather", gatherStart);
+	}
+	if (data -> toneMode != TONE_MODE_NONE) {
+		double reduceStart = traceNow();
+		reduceLogAverageLuminance(partial, MPI_COMM_WORLD);
+		traceEvent("reduce", reduceStart);
+	}
+	countersPhase(COUNTER_PHASE_NONE);
 }
 
 void slaveStaticBlocks(ConfigData* data) {
 	double computationStart, computationStop, computationTime;
+	countersPhase(COUNTER_PHASE_COMPUTE);
 	computationStart = MPI_Wtime();
 	StaticBlock staticBlock = StaticBlock(data);
 	if (staticBlock.sqrtProcessors == 0) {return;}
 	int size = staticBlock.getSize();
 	float *pixels = new float[size];
+	double tileStart = traceNow();
 	for (int row = 0; row < staticBlock.rowsToCalc; ++row) {
 		for (int col = 0; col < staticBlock.colsToCalc; ++col) {
 			int baseIdx = staticBlock.getIndex(row, col);
-			shadePixel(&(pixels[baseIdx]), staticBlock.rowStart + row, staticBlock.colStart + col, data);
+			shadeTracedPixel(&(pixels[baseIdx]), staticBlock.rowStart + row, staticBlock.colStart + col, data);
 		}
 	}
+	traceTile(staticBlock.rowStart, staticBlock.colStart, staticBlock.rowsToCalc, staticBlock.colsToCalc, tileStart);
 	computationStop = MPI_Wtime();
 	computationTime = computationStart - computationStop;
+	if (data -> toneMode != TONE_MODE_NONE) {
+		double partial[2] = {0.0, 0.0};
+		int numPixels = staticBlock.rowsToCalc * staticBlock.colsToCalc;
+		accumulateLogLuminance(data, pixels, numPixels, partial);
+		double reduceStart = traceNow();
+		double logAverage = reduceLogAverageLuminance(partial, MPI_COMM_WORLD);
+		traceEvent("reduce", reduceStart);
+		toneMapPixels(data, pixels, numPixels, logAverage);
+	}
 	pixels[size - 1] = computationTime;
+	countersPhase(COUNTER_PHASE_COMMUNICATE);
+	double barrierStart = traceNow();
 	MPI_Barrier(MPI_COMM_WORLD);
-	MPI_Send(pixels, size, MPI_FLOAT, 0, 8, MPI_COMM_WORLD);
+	traceEvent("barrier", barrierStart);
+	if (data -> hierarchical) {
+		PackedRegions regions;
+		regions.add(staticBlock.rowStart, staticBlock.colStart, staticBlock.rowsToCalc, staticBlock.colsToCalc, pixels);
+		double gatherStart = traceNow();
+		gatherRegions(data, &regions, NULL, &computationTime);
+		traceEvent("gather", gatherStart);
+	}
+	else {
+		double sendStart = traceNow();
+		sendPixelPacket(data, pixels, size, size - 1, 0, 8);
+		traceEvent("send", sendStart);
+	}
+	countersPhase(COUNTER_PHASE_NONE);
 	delete[] pixels;
 }
+
+void slaveDynamicFrames(ConfigData* data, const FrameSet* frames) {
+	MPI_Status status;
+	DynamicBlock dynamicBlock = DynamicBlock(data);
+	int numBlocks = dynamicBlock.numBlocksWide * dynamicBlock.numBlocksTall;
+	int totalBlocks = numBlocks * frames -> size();
+	int blockID = data -> mpi_rank - 1 < totalBlocks ? data -> mpi_rank - 1 : -1;
+	int frame = -1;
+	dynamicBlock.updateDynamicBlockData(data, 0);
+	int size = dynamicBlock.getSize();
+	float* packet = new float[size];
+
+	double computationStart, computationStop, computationTime;
+	computationTime = 0.0;
+
+	while (blockID != -1) {
+		//Block IDs only grow, so once a block of a new frame arrives the
+		//previous frame's scene is no longer needed.
+		if (blockID / numBlocks != frame) {
+			frame = blockID / numBlocks;
+			if (loadFrame(data, frames, frame)) {
+				MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+			}
+		}
+		dynamicBlock.updateDynamicBlockData(data, blockID % numBlocks);
+		computationStart = MPI_Wtime();
+		for(int row = 0; row < dynamicBlock.blockRowNum; ++row) {
+			for (int col = 0; col < dynamicBlock.blockColNum; ++col) {
+				int baseIdx = dynamicBlock.getIndex(row, col);
+				shadeTracedPixel(&(packet[baseIdx]), row + dynamicBlock.blockRowStart, col + dynamicBlock.blockColStart, data);
+			}
+		}
+		computationStop = MPI_Wtime();
+		computationTime += computationStop - computationStart;
+		packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_BLOCK_ID] = blockID;
+		packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_SLAVE] = data -> mpi_rank;
+		packet[DynamicBlock::DYNAMIC_PACKET::DYNAMIC_PACKET_COMPUTATION_TIME] = computationTime;
+
+		MPI_Send(packet, size, MPI_FLOAT, 0, 8, MPI_COMM_WORLD);
+
+		MPI_Recv(&blockID, 1, MPI_INT, 0, MPI_TAG_DYNAMIC, MPI_COMM_WORLD, &status);
+	}
+	delete[] packet;
+}
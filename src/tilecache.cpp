@@ -0,0 +1,266 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mpi.h>
+
+#include "tilecache.h"
+#include "master.h"
+#include "tone.h"
+
+//The first bytes of every cached block, followed by its RGB floats.
+typedef struct TileHeader {
+	char magic[4];
+	int rows;
+	int cols;
+} TileHeader;
+
+static const char TILE_MAGIC[4] = {'R', 'T', 'T', 'C'};
+
+typedef struct CachedTile {
+	struct timespec used;
+	off_t size;
+	std::string path;
+} CachedTile;
+
+//Least recently used first.
+static bool usedEarlier(const CachedTile& a, const CachedTile& b) {
+	return a.used.tv_sec != b.used.tv_sec ? a.used.tv_sec < b.used.tv_sec : a.used.tv_nsec < b.used.tv_nsec;
+}
+
+static unsigned long long sceneHash = 0;
+static int lookups = 0;
+static int hits = 0;
+static int stored = 0;
+
+//64-bit FNV-1a.
+static unsigned long long hashBytes(unsigned long long hash, const char* bytes, size_t size) {
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ (unsigned char)bytes[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool readFile(const std::string& path, std::string* contents) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in) {
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << in.rdbuf();
+	*contents = buffer.str();
+	return true;
+}
+
+//Hashes a model file and the material libraries it names.
+static unsigned long long hashModel(unsigned long long hash, const std::string& path) {
+	std::string model;
+	if (!readFile(path, &model)) {
+		return hash;
+	}
+	hash = hashBytes(hash, model.c_str(), model.size());
+	size_t slash = path.rfind('/');
+	std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+	std::istringstream lines(model);
+	std::string line;
+	while (std::getline(lines, line)) {
+		if (line.compare(0, 7, "mtllib ") != 0) {
+			continue;
+		}
+		std::string name = line.substr(7);
+		name.erase(name.find_last_not_of(" \t\r") + 1);
+		std::string material;
+		if (readFile(directory + name, &material)) {
+			hash = hashBytes(hash, material.c_str(), material.size());
+		}
+	}
+	return hash;
+}
+
+bool tileCacheOpen(const ConfigData* data, int argc, char* argv[]) {
+	//Only the master reads and writes the cache.
+	int rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	if (data -> tileCacheDir.empty() || rank != 0) {
+		return false;
+	}
+	const char* config = NULL;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], "-c") == 0) {
+			config = argv[i + 1];
+		}
+	}
+	std::string xml;
+	if (config == NULL || !readFile(config, &xml)) {
+		std::cerr << "ERROR: The tile cache requires a readable -c <ConfigFile>." << std::endl;
+		return true;
+	}
+	if (mkdir(data -> tileCacheDir.c_str(), 0755) != 0 && errno != EEXIST) {
+		std::cerr << "ERROR: Could not create the tile cache " << data -> tileCacheDir << " (" << strerror(errno) << ")." << std::endl;
+		return true;
+	}
+	//The camera and sampling settings are part of the scene file.
+	sceneHash = hashBytes(14695981039346656037ULL, xml.c_str(), xml.size());
+	for (size_t path = xml.find("<Path>"); path != std::string::npos; path = xml.find("<Path>", path + 1)) {
+		size_t end = xml.find("</Path>", path);
+		if (end != std::string::npos) {
+			sceneHash = hashModel(sceneHash, xml.substr(path + 6, end - path - 6));
+		}
+	}
+	return false;
+}
+
+bool tileCacheCheck(const ConfigData* data) {
+	if (data -> tileCacheDir.empty()) {
+		return false;
+	}
+	if (data -> partitioningMode != PART_MODE_DYNAMIC || data -> dynamicRMA || data -> hierarchical ||
+		data -> timeBudget > 0.0f || !data -> cameraPath.empty()) {
+		if (data -> mpi_rank == 0) {
+			std::cerr << "ERROR: -tilecache needs -p dynamic without -rma, -hier, -timebudget or -path." << std::endl;
+		}
+		return true;
+	}
+	return false;
+}
+
+static std::string tilePath(const ConfigData* data, const DynamicBlock* dynamicBlock) {
+	int key[6] = {data -> width, data -> height, dynamicBlock -> blockRowStart, dynamicBlock -> blockColStart,
+		dynamicBlock -> blockRowNum, dynamicBlock -> blockColNum};
+	unsigned long long hash = hashBytes(sceneHash, (const char*)key, sizeof(key));
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.tile", hash);
+	return data -> tileCacheDir + name;
+}
+
+//Maps a cached block and copies it into the image.
+static bool readTile(const ConfigData* data, DynamicBlock* dynamicBlock, const std::string& path, float* pixels, double* partial) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	size_t size = sizeof(TileHeader) + dynamicBlock -> getNumOfPixels() * sizeof(float);
+	struct stat info;
+	void* map = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && (size_t)info.st_size == size) {
+		map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) {
+		return false;
+	}
+	const TileHeader* header = (const TileHeader*)map;
+	const float* tile = (const float*)((const char*)map + sizeof(TileHeader));
+	bool valid = memcmp(header -> magic, TILE_MAGIC, 4) == 0 && header -> rows == dynamicBlock -> blockRowNum &&
+		header -> cols == dynamicBlock -> blockColNum;
+	if (valid) {
+		for (int row = 0; row < dynamicBlock -> blockRowNum; ++row) {
+			memcpy(&(pixels[getIndex(data, dynamicBlock -> blockRowStart + row, dynamicBlock -> blockColStart)]),
+				&tile[3 * row * dynamicBlock -> blockColNum], 3 * dynamicBlock -> blockColNum * sizeof(float));
+		}
+		if (data -> toneMode != TONE_MODE_NONE) {
+			accumulateLogLuminance(data, tile, dynamicBlock -> blockRowNum * dynamicBlock -> blockColNum, partial);
+		}
+	}
+	munmap(map, size);
+	//The modification time orders the blocks for eviction.
+	if (valid) {
+		utimensat(AT_FDCWD, path.c_str(), NULL, 0);
+	}
+	return valid;
+}
+
+void tileCacheLookup(const ConfigData* data, DynamicBlock* dynamicBlock, float* pixels, std::vector<int>* schedule, double* partial) {
+	if (data -> tileCacheDir.empty()) {
+		return;
+	}
+	lookups = hits = stored = 0;
+	std::vector<int> missing;
+	for (size_t i = 0; i < schedule -> size(); ++i) {
+		dynamicBlock -> updateDynamicBlockData(data, (*schedule)[i]);
+		++lookups;
+		if (readTile(data, dynamicBlock, tilePath(data, dynamicBlock), pixels, partial)) {
+			++hits;
+		}
+		else {
+			missing.push_back((*schedule)[i]);
+		}
+	}
+	schedule -> swap(missing);
+}
+
+void tileCacheStore(const ConfigData* data, DynamicBlock* dynamicBlock, const float* packet) {
+	if (data -> tileCacheDir.empty()) {
+		return;
+	}
+	//Written under a temporary name and renamed, so that a block is
+	//either complete or absent, even with several jobs sharing the cache.
+	std::string path = tilePath(data, dynamicBlock);
+	std::ostringstream temporary;
+	temporary << path << ".tmp" << getpid();
+	TileHeader header;
+	memcpy(header.magic, TILE_MAGIC, 4);
+	header.rows = dynamicBlock -> blockRowNum;
+	header.cols = dynamicBlock -> blockColNum;
+	FILE* file = fopen(temporary.str().c_str(), "wb");
+	if (file == NULL) {
+		return;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(&(packet[DynamicBlock::DYNAMIC_PACKET_MAX]), sizeof(float), dynamicBlock -> getNumOfPixels(), file) == (size_t)dynamicBlock -> getNumOfPixels();
+	written = fclose(file) == 0 && written;
+	if (written && rename(temporary.str().c_str(), path.c_str()) == 0) {
+		++stored;
+	}
+	else {
+		unlink(temporary.str().c_str());
+	}
+}
+
+void tileCacheClose(const ConfigData* data) {
+	if (data -> tileCacheDir.empty()) {
+		return;
+	}
+	std::vector<CachedTile> tiles;
+	off_t total = 0;
+	DIR* directory = opendir(data -> tileCacheDir.c_str());
+	if (directory != NULL) {
+		struct dirent* entry;
+		while ((entry = readdir(directory)) != NULL) {
+			std::string name = entry -> d_name;
+			if (name.size() < 5 || name.compare(name.size() - 5, 5, ".tile") != 0) {
+				continue;
+			}
+			CachedTile tile;
+			tile.path = data -> tileCacheDir + "/" + name;
+			struct stat info;
+			if (stat(tile.path.c_str(), &info) == 0) {
+				tile.used = info.st_mtim;
+				tile.size = info.st_size;
+				tiles.push_back(tile);
+				total += info.st_size;
+			}
+		}
+		closedir(directory);
+	}
+	std::sort(tiles.begin(), tiles.end(), usedEarlier);
+	off_t limit = (off_t)data -> tileCacheSize * 1024 * 1024;
+	int evicted = 0;
+	for (size_t i = 0; i < tiles.size() && total > limit; ++i) {
+		if (unlink(tiles[i].path.c_str()) == 0) {
+			total -= tiles[i].size;
+			++evicted;
+		}
+	}
+	std::cout << "Tile Cache Hits: " << hits << " of " << lookups << " (" << (lookups > 0 ? 100.0 * hits / lookups : 0.0) << "%)" << std::endl;
+	std::cout << "Tile Cache Size: " << total / (1024.0 * 1024.0) << " MB, " << stored << " blocks stored, " << evicted << " evicted" << std::endl;
+}
@@ -0,0 +1,124 @@
+#include <cmath>
+#include <cstring>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "tone.h"
+
+//Small offset that keeps black pixels from sending the log to -infinity.
+static const double LOG_DELTA = 1.0e-4;
+
+void accumulateLogLuminance(const ConfigData* data, const float* pixels, int numPixels, double* partial) {
+	double sum = 0.0;
+	for (int i = 0; i < numPixels; ++i) {
+		const float* p = &pixels[3 * i];
+		double luminance = 0.27 * p[0] + 0.67 * p[1] + 0.06 * p[2];
+		sum += log(LOG_DELTA + data -> toneWorldLuminance * luminance);
+	}
+	partial[0] += sum;
+	partial[1] += numPixels;
+}
+
+double logAverageLuminance(const double* partial) {
+	if (partial[1] <= 0.0) {
+		return 1.0;
+	}
+	return exp(partial[0] / partial[1]);
+}
+
+double reduceLogAverageLuminance(double* partial, MPI_Comm comm) {
+	double total[2];
+	MPI_Allreduce(partial, total, 2, MPI_DOUBLE, MPI_SUM, comm);
+	return logAverageLuminance(total);
+}
+
+//Both operators reduce to out = v * scale / (1 + v * bias) per channel,
+//with bias = 0 for Ward and bias = scale for Reinhard.
+static void toneScale(const ConfigData* data, double logAverage, float* scale, float* bias) {
+	float lmax = data -> toneWorldLuminance;
+	float ldmax = data -> toneDisplayLuminance;
+	if (data -> toneMode == TONE_MODE_REINHARD) {
+		*scale = (float)(data -> toneKey / logAverage) * lmax;
+		*bias = *scale;
+	}
+	else {
+		double sf = pow((1.219 + pow(ldmax / 2.0, 0.4)) / (1.219 + pow(logAverage, 0.4)), 2.5);
+		*scale = (float)sf * lmax / ldmax;
+		*bias = 0.0f;
+	}
+}
+
+void toneMapPixels(const ConfigData* data, float* pixels, int numPixels, double logAverage) {
+	if (data -> toneMode == TONE_MODE_NONE) {
+		return;
+	}
+	float scale, bias;
+	toneScale(data, logAverage, &scale, &bias);
+	int numValues = 3 * numPixels;
+	int i = 0;
+#ifdef __SSE__
+	__m128 vScale = _mm_set1_ps(scale);
+	__m128 vBias = _mm_set1_ps(bias);
+	__m128 vOne = _mm_set1_ps(1.0f);
+	for (; i + 4 <= numValues; i += 4) {
+		__m128 v = _mm_loadu_ps(&pixels[i]);
+		__m128 num = _mm_mul_ps(v, vScale);
+		__m128 den = _mm_add_ps(vOne, _mm_mul_ps(v, vBias));
+		_mm_storeu_ps(&pixels[i], _mm_div_ps(num, den));
+	}
+#endif
+	for (; i < numValues; ++i) {
+		pixels[i] = pixels[i] * scale / (1.0f + pixels[i] * bias);
+	}
+}
+
+void toneMapFrame(const ConfigData* data, float* pixels) {
+	if (data -> toneMode == TONE_MODE_NONE) {
+		return;
+	}
+	int numPixels = data -> width * data -> height;
+	double partial[2] = {0.0, 0.0};
+	accumulateLogLuminance(data, pixels, numPixels, partial);
+	toneMapPixels(data, pixels, numPixels, logAverageLuminance(partial));
+}
+
+//The library truncates v * 255 when writing the image, so a byte b is
+//expanded to the middle of its bucket to come back out as b.
+static void quantizePixels(const float* pixels, unsigned char* bytes, int numValues) {
+	for (int i = 0; i < numValues; ++i) {
+		float v = pixels[i];
+		v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+		bytes[i] = (unsigned char)(v * 255.0f);
+	}
+}
+
+static void dequantizePixels(const unsigned char* bytes, float* pixels, int numValues) {
+	for (int i = 0; i < numValues; ++i) {
+		pixels[i] = (bytes[i] + 0.5f) / 255.0f;
+	}
+}
+
+void sendPixelPacket(const ConfigData* data, float* packet, int size, int timeIdx, int dest, int tag) {
+	if (data -> toneMode == TONE_MODE_NONE) {
+		MPI_Send(packet, size, MPI_FLOAT, dest, tag, MPI_COMM_WORLD);
+		return;
+	}
+	unsigned char* bytes = new unsigned char[sizeof(float) + size];
+	memcpy(bytes, &packet[timeIdx], sizeof(float));
+	quantizePixels(packet, bytes + sizeof(float), size);
+	MPI_Send(bytes, sizeof(float) + size, MPI_UNSIGNED_CHAR, dest, tag, MPI_COMM_WORLD);
+	delete[] bytes;
+}
+
+void recvPixelPacket(const ConfigData* data, float* packet, int size, int timeIdx, int source, int tag, MPI_Status* status) {
+	if (data -> toneMode == TONE_MODE_NONE) {
+		MPI_Recv(packet, size, MPI_FLOAT, source, tag, MPI_COMM_WORLD, status);
+		return;
+	}
+	unsigned char* bytes = new unsigned char[sizeof(float) + size];
+	MPI_Recv(bytes, sizeof(float) + size, MPI_UNSIGNED_CHAR, source, tag, MPI_COMM_WORLD, status);
+	dequantizePixels(bytes + sizeof(float), packet, size);
+	memcpy(&packet[timeIdx], bytes, sizeof(float));
+	delete[] bytes;
+}
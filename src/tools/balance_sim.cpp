@@ -0,0 +1,416 @@
+//Predicts how the partitioning modes of raytrace_mpi balance a scene,
+//from the per-pixel cost map (_cost.bin) of one render with -trace. The
+//schedules mirror those of master.cpp and slave.cpp; the gathers and the
+//dynamic master are modeled with a network latency and bandwidth.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <queue>
+#include <string>
+#include <algorithm>
+
+typedef struct
+{
+    int width, height;
+    //Nanoseconds per pixel.
+    std::vector<float> cost;
+} CostMap;
+
+typedef struct
+{
+    double latency;
+    double bandwidth;
+} Network;
+
+//One simulated configuration. The computation time is that of the busiest
+//rank; everything else up to the makespan is communication or waiting, as
+//in the times raytrace_mpi reports.
+typedef struct
+{
+    int procs;
+    std::string mode;
+    std::string parameter;
+    double makespan;
+    double computation;
+    double communication;
+    double imbalance;
+} Prediction;
+
+bool read_cost_map(const char* file, CostMap* map)
+{
+    FILE* fp = fopen(file, "rb");
+    if(fp == NULL)
+    {
+        std::cerr << "Could not open " << file << "." << std::endl;
+        return false;
+    }
+    bool valid = fread(&map->width, sizeof(int), 1, fp) == 1 && fread(&map->height, sizeof(int), 1, fp) == 1 &&
+        map->width > 0 && map->height > 0;
+    if(valid)
+    {
+        map->cost.resize((size_t)map->width * map->height);
+        valid = fread(&map->cost[0], sizeof(float), map->cost.size(), fp) == map->cost.size();
+    }
+    fclose(fp);
+    if(!valid)
+    {
+        std::cerr << file << " is not a cost map written by -trace." << std::endl;
+    }
+    return valid;
+}
+
+//The time of a message of the given number of floats.
+double message_time(const Network* network, double floats)
+{
+    return network->latency + floats * sizeof(float) / network->bandwidth;
+}
+
+//The seconds it takes to render a rectangle of pixels.
+double region_cost(const CostMap* map, int rowStart, int colStart, int rows, int cols)
+{
+    double ns = 0.0;
+    for(int row = rowStart; row < rowStart + rows; ++row)
+    {
+        for(int col = colStart; col < colStart + cols; ++col)
+        {
+            ns += map->cost[(size_t)row * map->width + col];
+        }
+    }
+    return ns * 1e-9;
+}
+
+//Fills in the times of a static mode: every rank renders its part, waits
+//at the barrier, and the master receives the packets one after another.
+Prediction static_prediction(int procs, const char* mode, const std::string& parameter,
+    const std::vector<double>& computation, double gather)
+{
+    Prediction prediction;
+    prediction.procs = procs;
+    prediction.mode = mode;
+    prediction.parameter = parameter;
+    double sum = 0.0, busiest = 0.0;
+    for(size_t i = 0; i < computation.size(); ++i)
+    {
+        sum += computation[i];
+        busiest = std::max(busiest, computation[i]);
+    }
+    prediction.computation = busiest;
+    prediction.communication = gather;
+    prediction.makespan = busiest + gather;
+    prediction.imbalance = sum > 0.0 ? busiest / (sum / computation.size()) - 1.0 : 0.0;
+    return prediction;
+}
+
+Prediction strips_vertical(const CostMap* map, const Network* network, int procs)
+{
+    int colsN = map->width / procs;
+    int colsE = colsN + 1;
+    int colsR = map->width % procs;
+    std::vector<double> computation(procs);
+    for(int rank = 0; rank < procs; ++rank)
+    {
+        int cols = rank < colsR ? colsE : colsN;
+        int colStart = rank < colsR ? colsE * rank : colsE * colsR + (rank - colsR) * colsN;
+        computation[rank] = region_cost(map, 0, colStart, map->height, cols);
+    }
+    double gather = 0.0;
+    for(int slave = 1; slave < procs; ++slave)
+    {
+        gather += message_time(network, 3.0 * map->height * (slave < colsR ? colsE : colsN) + 1);
+    }
+    return static_prediction(procs, "static_strips_vertical", "-", computation, gather);
+}
+
+Prediction cycles_horizontal(const CostMap* map, const Network* network, int procs, int cycleSize)
+{
+    std::vector<double> computation(procs, 0.0);
+    for(int row = 0; row < map->height; ++row)
+    {
+        computation[(row / cycleSize) % procs] += region_cost(map, row, 0, 1, map->width);
+    }
+    //Every slave sends a packet sized for its share plus one cycle.
+    int rowsPerProc = map->height / procs + cycleSize;
+    double gather = (procs - 1) * message_time(network, 3.0 * map->width * rowsPerProc + 1);
+    std::ostringstream parameter;
+    parameter << "-cs " << cycleSize;
+    return static_prediction(procs, "static_cycles_horizontal", parameter.str(), computation, gather);
+}
+
+Prediction static_blocks(const CostMap* map, const Network* network, int procs, int sqrtProcs)
+{
+    //The same arithmetic as StaticBlock::updateStaticBlockData().
+    int rowsN = map->height / sqrtProcs, rowsRS = map->height - map->height % sqrtProcs;
+    int colsN = map->width / sqrtProcs, colsRS = map->width - map->width % sqrtProcs;
+    std::vector<double> computation(procs);
+    double gather = 0.0;
+    for(int rank = 0; rank < procs; ++rank)
+    {
+        int blockRow = rank / sqrtProcs, blockCol = rank % sqrtProcs;
+        int rows = blockRow >= rowsRS ? rowsN + 1 : rowsN;
+        int rowStart = blockRow >= rowsRS ? rowsRS * rowsN + (blockRow - rowsRS) * (rowsN + 1) : blockRow * rowsN;
+        int cols = blockCol >= colsRS ? colsN + 1 : colsN;
+        int colStart = blockCol >= colsRS ? colsRS * colsN + (blockCol - colsRS) * (colsN + 1) : blockCol * colsN;
+        computation[rank] = region_cost(map, rowStart, colStart, rows, cols);
+        if(rank > 0)
+        {
+            gather += message_time(network, 3.0 * (rows + 1) * cols + 1);
+        }
+    }
+    return static_prediction(procs, "static_blocks", "-", computation, gather);
+}
+
+//A slave's result waiting for the master.
+typedef struct
+{
+    double arrival;
+    int slave;
+} Arrival;
+
+bool arrives_later(const Arrival& a, const Arrival& b)
+{
+    return a.arrival > b.arrival || (a.arrival == b.arrival && a.slave > b.slave);
+}
+
+//Slave s starts on block s - 1; the master then receives the results one
+//at a time, in the order they arrive, and answers each with the next
+//block in row order.
+Prediction dynamic_blocks(const CostMap* map, const Network* network, int procs, int blockHeight, int blockWidth)
+{
+    int numBlocksWide = (map->width + blockWidth - 1) / blockWidth;
+    int numBlocksTall = (map->height + blockHeight - 1) / blockHeight;
+    int numBlocks = numBlocksWide * numBlocksTall;
+    std::vector<double> blockCost(numBlocks);
+    for(int block = 0; block < numBlocks; ++block)
+    {
+        int rowStart = (block / numBlocksWide) * blockHeight, colStart = (block % numBlocksWide) * blockWidth;
+        blockCost[block] = region_cost(map, rowStart, colStart, std::min(blockHeight, map->height - rowStart),
+            std::min(blockWidth, map->width - colStart));
+    }
+    //Every packet is sized for a full block.
+    double packetTime = message_time(network, 3.0 * blockHeight * blockWidth + 3) - network->latency;
+
+    int slaves = procs - 1;
+    std::vector<double> computation(slaves, 0.0);
+    std::priority_queue<Arrival, std::vector<Arrival>, bool (*)(const Arrival&, const Arrival&)> arrivals(arrives_later);
+    int next = 0;
+    for(int slave = 0; slave < slaves && next < numBlocks; ++slave, ++next)
+    {
+        computation[slave] += blockCost[next];
+        Arrival arrival = {blockCost[next] + network->latency, slave};
+        arrivals.push(arrival);
+    }
+    double masterFree = 0.0;
+    while(!arrivals.empty())
+    {
+        Arrival arrival = arrivals.top();
+        arrivals.pop();
+        masterFree = std::max(masterFree, arrival.arrival) + packetTime;
+        if(next < numBlocks)
+        {
+            double start = masterFree + network->latency;
+            computation[arrival.slave] += blockCost[next];
+            Arrival result = {start + blockCost[next] + network->latency, arrival.slave};
+            arrivals.push(result);
+            ++next;
+        }
+    }
+
+    std::ostringstream parameter;
+    parameter << "-bh " << blockHeight << " -bw " << blockWidth;
+    Prediction prediction = static_prediction(procs, "dynamic", parameter.str(), computation, 0.0);
+    prediction.makespan = masterFree;
+    prediction.communication = masterFree - prediction.computation;
+    return prediction;
+}
+
+bool parse_list(const char* value, std::vector<int>* list)
+{
+    list->clear();
+    std::stringstream items(value);
+    std::string item;
+    while(std::getline(items, item, ','))
+    {
+        int number = atoi(item.c_str());
+        if(number <= 0)
+        {
+            return false;
+        }
+        list->push_back(number);
+    }
+    return !list->empty();
+}
+
+//Block sizes are given as HxW, or as one number for square blocks.
+bool parse_blocks(const char* value, std::vector<std::pair<int, int> >* blocks)
+{
+    blocks->clear();
+    std::stringstream items(value);
+    std::string item;
+    while(std::getline(items, item, ','))
+    {
+        size_t x = item.find('x');
+        int height = atoi(item.c_str());
+        int width = x == std::string::npos ? height : atoi(item.c_str() + x + 1);
+        if(height <= 0 || width <= 0)
+        {
+            return false;
+        }
+        blocks->push_back(std::make_pair(height, width));
+    }
+    return !blocks->empty();
+}
+
+bool by_makespan(const Prediction& a, const Prediction& b)
+{
+    return a.procs != b.procs ? a.procs < b.procs : a.makespan < b.makespan;
+}
+
+void usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [-np list] [-blocks list] [-cycles list] [-modes list] [-latency us]" << std::endl;
+    std::cerr << "       [-bandwidth MB/s] [-csv file] cost.bin" << std::endl;
+    std::cerr << "    cost.bin   The per-pixel cost map written next to the image by raytrace_mpi -trace" << std::endl;
+    std::cerr << "    -np        The process counts (default 4,9,16,25,36,64)" << std::endl;
+    std::cerr << "    -blocks    The dynamic block sizes as HxW or N for NxN (default 8,16,32,64,10x10,25x25,50x50)" << std::endl;
+    std::cerr << "    -cycles    The cycle sizes of static_cycles_horizontal (default 1,2,4,8,10,16,32,50)" << std::endl;
+    std::cerr << "    -modes     The modes: static_strips_vertical, static_cycles_horizontal, static_blocks" << std::endl;
+    std::cerr << "               and dynamic (default all)" << std::endl;
+    std::cerr << "    -latency   The latency of a message in microseconds (default 5)" << std::endl;
+    std::cerr << "    -bandwidth The bandwidth into the master in MB/s (default 1000)" << std::endl;
+    std::cerr << "    -csv       Also write every prediction to this file" << std::endl;
+    std::cerr << "static_blocks is only simulated for square process counts, and dynamic for two or more." << std::endl;
+    std::cerr << "Record the cost map with at most one rank per core, or the pixel costs include the time" << std::endl;
+    std::cerr << "the ranks waited for each other's cores." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<int> procs, cycles;
+    std::vector<std::pair<int, int> > blocks;
+    parse_list("4,9,16,25,36,64", &procs);
+    parse_list("1,2,4,8,10,16,32,50", &cycles);
+    parse_blocks("8,16,32,64,10x10,25x25,50x50", &blocks);
+    std::string modes = "static_strips_vertical,static_cycles_horizontal,static_blocks,dynamic";
+    Network network = {5e-6, 1000e6};
+    const char* csvFile = NULL;
+    const char* costFile = NULL;
+    bool valid = true;
+    for(int i = 1; i < argc && valid; ++i)
+    {
+        if(strcmp(argv[i], "-np") == 0 && i + 1 < argc)
+        {
+            valid = parse_list(argv[++i], &procs);
+        }
+        else if(strcmp(argv[i], "-blocks") == 0 && i + 1 < argc)
+        {
+            valid = parse_blocks(argv[++i], &blocks);
+        }
+        else if(strcmp(argv[i], "-cycles") == 0 && i + 1 < argc)
+        {
+            valid = parse_list(argv[++i], &cycles);
+        }
+        else if(strcmp(argv[i], "-modes") == 0 && i + 1 < argc)
+        {
+            modes = argv[++i];
+        }
+        else if(strcmp(argv[i], "-latency") == 0 && i + 1 < argc)
+        {
+            network.latency = atof(argv[++i]) * 1e-6;
+            valid = network.latency >= 0.0;
+        }
+        else if(strcmp(argv[i], "-bandwidth") == 0 && i + 1 < argc)
+        {
+            network.bandwidth = atof(argv[++i]) * 1e6;
+            valid = network.bandwidth > 0.0;
+        }
+        else if(strcmp(argv[i], "-csv") == 0 && i + 1 < argc)
+        {
+            csvFile = argv[++i];
+        }
+        else
+        {
+            valid = costFile == NULL;
+            costFile = argv[i];
+        }
+    }
+
+    //Make sure the input is provided.
+    if(!valid || costFile == NULL)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    CostMap map;
+    if(!read_cost_map(costFile, &map))
+    {
+        return 1;
+    }
+    double sequential = region_cost(&map, 0, 0, map.height, map.width);
+    std::string list = "," + modes + ",";
+
+    std::vector<Prediction> predictions;
+    for(size_t p = 0; p < procs.size(); ++p)
+    {
+        int n = procs[p];
+        if(list.find(",static_strips_vertical,") != std::string::npos)
+        {
+            predictions.push_back(strips_vertical(&map, &network, n));
+        }
+        for(size_t c = 0; c < cycles.size() && list.find(",static_cycles_horizontal,") != std::string::npos; ++c)
+        {
+            predictions.push_back(cycles_horizontal(&map, &network, n, cycles[c]));
+        }
+        int root = (int)std::lround(std::sqrt((double)n));
+        if(root * root == n && list.find(",static_blocks,") != std::string::npos)
+        {
+            predictions.push_back(static_blocks(&map, &network, n, root));
+        }
+        for(size_t b = 0; b < blocks.size() && n > 1 && list.find(",dynamic,") != std::string::npos; ++b)
+        {
+            predictions.push_back(dynamic_blocks(&map, &network, n, blocks[b].first, blocks[b].second));
+        }
+    }
+    std::stable_sort(predictions.begin(), predictions.end(), by_makespan);
+
+    std::cout << "Cost Map: " << map.width << " x " << map.height << std::endl;
+    std::cout << "Sequential Time: " << sequential << " seconds" << std::endl;
+    std::cout << "Network: " << network.latency * 1e6 << " us latency, " << network.bandwidth * 1e-6 << " MB/s" << std::endl;
+    std::ofstream csv;
+    if(csvFile != NULL)
+    {
+        csv.open(csvFile);
+        csv << "procs,mode,param,makespan,computation,communication,c2c_ratio,imbalance,speedup" << std::endl;
+    }
+    for(size_t i = 0; i < predictions.size(); ++i)
+    {
+        const Prediction& prediction = predictions[i];
+        if(i == 0 || prediction.procs != predictions[i - 1].procs)
+        {
+            std::cout << std::endl << "Processes: " << prediction.procs << std::endl;
+            std::cout << std::left << std::setw(26) << "Mode" << std::setw(18) << "Parameter" << std::right
+                << std::setw(14) << "Makespan (s)" << std::setw(14) << "Comp. (s)" << std::setw(14) << "Comm. (s)"
+                << std::setw(10) << "C-to-C" << std::setw(12) << "Imbalance" << std::setw(10) << "Speedup" << std::endl;
+        }
+        double c2cRatio = prediction.computation > 0.0 ? prediction.communication / prediction.computation : 0.0;
+        double speedup = prediction.makespan > 0.0 ? sequential / prediction.makespan : 0.0;
+        std::cout << std::left << std::setw(26) << prediction.mode << std::setw(18) << prediction.parameter << std::right
+            << std::fixed << std::setprecision(4) << std::setw(14) << prediction.makespan << std::setw(14)
+            << prediction.computation << std::setw(14) << prediction.communication << std::setw(10) << c2cRatio
+            << std::setprecision(1) << std::setw(11) << 100.0 * prediction.imbalance << "%" << std::setprecision(2)
+            << std::setw(10) << speedup << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        if(csv.is_open())
+        {
+            csv << prediction.procs << "," << prediction.mode << "," << prediction.parameter << "," << prediction.makespan
+                << "," << prediction.computation << "," << prediction.communication << "," << c2cRatio << ","
+                << prediction.imbalance << "," << speedup << std::endl;
+        }
+    }
+    return 0;
+}
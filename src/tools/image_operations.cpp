@@ -2,6 +2,19 @@
 #include <png.h>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+//Exit codes, so that scripts can gate on the comparison.
+enum
+{
+    COMPARE_SAME = 0,
+    COMPARE_DIFFERENT = 1,
+    COMPARE_ERROR = 2
+};
 
 typedef struct
 {
@@ -10,11 +23,25 @@ typedef struct
     int width, height, number_of_passes;
     unsigned char color_type, bit_depth;
     png_bytep* row_pointers;
+    png_bytep pixels;
 } Image;
 
+//The differences found in a range of rows.
+typedef struct
+{
+    long long differing;
+    long long overTolerance;
+    unsigned long long squaredError;
+    int maxError;
+    int minRow, maxRow, minColumn, maxColumn;
+} Difference;
+
 bool read_png_file(char* file, Image* image)
 {
-    bool value = false;
+    //Set after setjmp, so it must survive a longjmp.
+    volatile bool value = false;
+    image->row_pointers = NULL;
+    image->pixels = NULL;
 
     //Keep space for the file header.
     png_byte header[8];
@@ -24,10 +51,7 @@ bool read_png_file(char* file, Image* image)
     if(fp != NULL)
     {
         //Read the first 8 bytes of the file.
-        fread(header, 1, 8, fp);
-
-        //Check the header.
-        if(!png_sig_cmp(header, 0, 8))
+        if(fread(header, 1, 8, fp) == 8 && !png_sig_cmp(header, 0, 8))
         {
             image->png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
             if(image->png_ptr != NULL)
@@ -37,7 +61,7 @@ bool read_png_file(char* file, Image* image)
                 {
                     if(setjmp(png_jmpbuf(image->png_ptr)))
                     {
-                        std::cerr << "Error during read initialization." << std::endl;
+                        std::cerr << "Error during read of " << file << "." << std::endl;
                     }
                     else
                     {
@@ -51,32 +75,34 @@ bool read_png_file(char* file, Image* image)
                         image->color_type = png_get_color_type(image->png_ptr, image->info_ptr);
                         image->bit_depth = png_get_bit_depth(image->png_ptr, image->info_ptr);
 
+                        //Compare everything as 8 bit RGB.
+                        png_set_strip_16(image->png_ptr);
+                        png_set_strip_alpha(image->png_ptr);
+                        png_set_palette_to_rgb(image->png_ptr);
+                        png_set_expand_gray_1_2_4_to_8(image->png_ptr);
+                        png_set_gray_to_rgb(image->png_ptr);
+
                         image->number_of_passes = png_set_interlace_handling(image->png_ptr);
                         png_read_update_info(image->png_ptr, image->info_ptr);
 
-                        if(setjmp(png_jmpbuf(image->png_ptr)))
+                        //Allocate the image as one block, with the rows pointing into it.
+                        size_t rowBytes = png_get_rowbytes(image->png_ptr, image->info_ptr);
+                        image->pixels = (png_bytep)malloc(rowBytes * image->height);
+                        image->row_pointers = new png_bytep[image->height];
+                        for(int y = 0; y < image->height; ++y)
                         {
-                            std::cerr << "Error during read." << std::endl;
-                        }
-                        else
-                        {
-                            //Allocate space for image.
-                            image->row_pointers = new png_bytep[image->height];
-                            for(int y = 0; y < image->height; ++y)
-                            {
-                                (image->row_pointers)[y] = (png_byte*)malloc(png_get_rowbytes(image->png_ptr, image->info_ptr));
-                            }
-
-                            png_read_image(image->png_ptr, image->row_pointers);
-                            value = true;
-                            fclose(fp);
+                            (image->row_pointers)[y] = image->pixels + rowBytes * y;
                         }
+
+                        png_read_image(image->png_ptr, image->row_pointers);
+                        value = true;
                     }
                 }
                 else
                 { 
                     std::cerr << "Info struct creation failed." << std::endl;
                 }
+                png_destroy_read_struct(&image->png_ptr, image->info_ptr != NULL ? &image->info_ptr : NULL, NULL);
             }
             else
             {
@@ -87,6 +113,7 @@ bool read_png_file(char* file, Image* image)
         {
             std::cerr << "The file (" << file << ") does not appear to be png." << std::endl;
         }
+        fclose(fp);
     }
     else
     {
@@ -98,74 +125,253 @@ bool read_png_file(char* file, Image* image)
 
 void deleteImage(Image* image)
 {
-    for(int y = 0; y < image->height; ++y)
+    free(image->pixels);
+    delete[] image->row_pointers;
+}
+
+//Writes an 8 bit RGB png.
+bool write_png_file(const char* file, int width, int height, const std::vector<png_byte>& pixels)
+{
+    FILE* fp = fopen(file, "wb");
+    if(fp == NULL)
     {
-        free((image->row_pointers)[y]);
+        std::cerr << "The file (" << file << ") could not be opened." << std::endl;
+        return false;
     }
-    delete[] image->row_pointers;
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info_ptr = png_ptr != NULL ? png_create_info_struct(png_ptr) : NULL;
+    bool value = false;
+    if(info_ptr == NULL)
+    {
+        std::cerr << "Creation of write struct failed." << std::endl;
+    }
+    else if(setjmp(png_jmpbuf(png_ptr)))
+    {
+        std::cerr << "Error during write of " << file << "." << std::endl;
+    }
+    else
+    {
+        png_init_io(png_ptr, fp);
+        png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+            PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(png_ptr, info_ptr);
+        for(int y = 0; y < height; ++y)
+        {
+            png_write_row(png_ptr, (png_bytep)&pixels[3 * (size_t)width * y]);
+        }
+        png_write_end(png_ptr, NULL);
+        value = true;
+    }
+    png_destroy_write_struct(&png_ptr, info_ptr != NULL ? &info_ptr : NULL);
+    fclose(fp);
+    return value;
 }
 
-void compare_images(Image* im1, Image* im2)
+//Compares the rows [rowStart, rowEnd). Identical rows are skipped with
+//memcmp; the loops over differing rows are simple enough for the
+//compiler to vectorize. If heat is not NULL, the largest channel
+//difference of every pixel is stored in it.
+void compare_rows(const Image* im1, const Image* im2, int rowStart, int rowEnd, int tolerance, png_byte* heat, Difference* result)
 {
-    //Check the width and height.
-    if( (im1->height == im2->height) && (im1->width == im2->width) )
+    Difference diff = {0, 0, 0, 0, im1->height, -1, im1->width, -1};
+    int values = 3 * im1->width;
+    std::vector<int> error(im1->width);
+    for(int row = rowStart; row < rowEnd; ++row)
     {
-        //Keep a counter for the number of different pixels.
-        int differing = 0;
+        const png_byte* im1r = (im1->row_pointers)[row];
+        const png_byte* im2r = (im2->row_pointers)[row];
+        if(memcmp(im1r, im2r, values) == 0)
+        {
+            continue;
+        }
+
+        unsigned long long squared = 0;
+        int rowMax = 0;
+        for(int i = 0; i < values; ++i)
+        {
+            int d = (int)im1r[i] - (int)im2r[i];
+            squared += d * d;
+            rowMax = std::max(rowMax, std::abs(d));
+        }
+        diff.squaredError += squared;
+        diff.maxError = std::max(diff.maxError, rowMax);
 
-        //Now, check each of the values in the image for equality.
-        for(int row = 0; row < im1->height; ++row)
+        for(int column = 0; column < im1->width; ++column)
         {
-            png_byte* im1r = (im1->row_pointers)[row];
-            png_byte* im2r = (im2->row_pointers)[row];
-            for(int column = 0; column < im1->width; ++column)
+            int r = std::abs((int)im1r[3 * column] - (int)im2r[3 * column]);
+            int g = std::abs((int)im1r[3 * column + 1] - (int)im2r[3 * column + 1]);
+            int b = std::abs((int)im1r[3 * column + 2] - (int)im2r[3 * column + 2]);
+            error[column] = std::max(r, std::max(g, b));
+        }
+        int first = -1, last = -1;
+        for(int column = 0; column < im1->width; ++column)
+        {
+            if(error[column] > 0)
             {
-                //Determine if the pixels are the same by comparing each of the RGB values.
-                if( (im1r[0] != im2r[0]) || (im1r[1] != im2r[1])
-                    || (im1r[2] != im2r[2]) )
+                if(first < 0)
                 {
-                    //We have encountered a difference here...
-                    std::cout << "ERROR: Pixel (" << row << "," << column << ") is different.";
-                    std::cout << " (R,G,B) values: 1.) (" << (int)im1r[0] << "," << (int)im1r[1] << "," << (int)im1r[2] << "); ";
-                    std::cout << "2.) (" << (int)im2r[0] << "," << (int)im2r[1] << "," << (int)im2r[2] << ")" << std::endl;
-
-                    //Mark it as a difference.
-                    differing++;
+                    first = column;
+                }
+                last = column;
+                ++diff.differing;
+                if(error[column] > tolerance)
+                {
+                    ++diff.overTolerance;
                 }
-
-                //Update the pointers to the next pixel.
-                im1r += 3; im2r += 3;
             }
         }
+        diff.minRow = std::min(diff.minRow, row);
+        diff.maxRow = row;
+        diff.minColumn = std::min(diff.minColumn, first);
+        diff.maxColumn = std::max(diff.maxColumn, last);
+        if(heat != NULL)
+        {
+            std::copy(error.begin(), error.end(), heat + (size_t)im1->width * row);
+        }
+    }
+    *result = diff;
+}
 
-        //Print the summary.
-        std::cout << std::endl << std::endl;
-        std::cout << "Number of different pixels: " << differing << std::endl;
-        std::cout << "Percent of image: " << (100.0 * differing / (im1->height * im1->width)) << "%" << std::endl;
+//Maps a difference to black (none) through red and yellow to white (the largest).
+void heat_color(int value, int maxValue, png_byte* rgb)
+{
+    float t = maxValue > 0 ? (float)value / maxValue : 0.0f;
+    rgb[0] = (png_byte)(255.0f * std::min(1.0f, 3.0f * t));
+    rgb[1] = (png_byte)(255.0f * std::min(1.0f, std::max(0.0f, 3.0f * t - 1.0f)));
+    rgb[2] = (png_byte)(255.0f * std::max(0.0f, 3.0f * t - 2.0f));
+}
+
+int compare_images(Image* im1, Image* im2, int tolerance, int threads, const char* heatFile)
+{
+    //Check the width and height.
+    if( (im1->height != im2->height) || (im1->width != im2->width) )
+    {
+        std::cout << "ERROR: Images have different dimensions" << std::endl;
+        return COMPARE_ERROR;
+    }
+
+    //Split the rows between the threads.
+    threads = std::max(1, std::min(threads, im1->height));
+    std::vector<png_byte> heat;
+    if(heatFile != NULL)
+    {
+        heat.assign((size_t)im1->width * im1->height, 0);
+    }
+    std::vector<Difference> results(threads);
+    std::vector<std::thread> workers;
+    for(int t = 0; t < threads; ++t)
+    {
+        int rowStart = (long long)im1->height * t / threads;
+        int rowEnd = (long long)im1->height * (t + 1) / threads;
+        workers.push_back(std::thread(compare_rows, im1, im2, rowStart, rowEnd, tolerance,
+            heat.empty() ? (png_byte*)NULL : &heat[0], &results[t]));
+    }
+    Difference total = {0, 0, 0, 0, im1->height, -1, im1->width, -1};
+    for(int t = 0; t < threads; ++t)
+    {
+        workers[t].join();
+        total.differing += results[t].differing;
+        total.overTolerance += results[t].overTolerance;
+        total.squaredError += results[t].squaredError;
+        total.maxError = std::max(total.maxError, results[t].maxError);
+        total.minRow = std::min(total.minRow, results[t].minRow);
+        total.maxRow = std::max(total.maxRow, results[t].maxRow);
+        total.minColumn = std::min(total.minColumn, results[t].minColumn);
+        total.maxColumn = std::max(total.maxColumn, results[t].maxColumn);
+    }
+
+    //Print the summary.
+    double pixels = (double)im1->height * im1->width;
+    double rmse = std::sqrt(total.squaredError / (3.0 * pixels));
+    std::cout << "Number of different pixels: " << total.differing << std::endl;
+    std::cout << "Percent of image: " << (100.0 * total.differing / pixels) << "%" << std::endl;
+    std::cout << "Pixels over tolerance " << tolerance << ": " << total.overTolerance << std::endl;
+    std::cout << "Max absolute error: " << total.maxError << std::endl;
+    std::cout << "RMSE: " << rmse << std::endl;
+    if(total.squaredError == 0)
+    {
+        std::cout << "PSNR: inf dB" << std::endl;
     }
     else
     {
-        std::cout << "ERROR: Images have different dimensions" << std::endl;
+        std::cout << "PSNR: " << 20.0 * std::log10(255.0 / rmse) << " dB" << std::endl;
     }
+    if(total.differing > 0)
+    {
+        std::cout << "Difference bounding box: (" << total.minRow << "," << total.minColumn << ") to ("
+            << total.maxRow << "," << total.maxColumn << ")" << std::endl;
+    }
+
+    if(heatFile != NULL)
+    {
+        std::vector<png_byte> rgb(3 * heat.size());
+        for(size_t i = 0; i < heat.size(); ++i)
+        {
+            heat_color(heat[i], total.maxError, &rgb[3 * i]);
+        }
+        if(!write_png_file(heatFile, im1->width, im1->height, rgb))
+        {
+            return COMPARE_ERROR;
+        }
+    }
+    return total.overTolerance > 0 ? COMPARE_DIFFERENT : COMPARE_SAME;
+}
+
+void usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [-t tolerance] [-threads n] [-diff heatmap.png] input1.png input2.png" << std::endl;
+    std::cerr << "    -t        Pixels whose largest channel difference is above this count as" << std::endl;
+    std::cerr << "              different for the exit code (default 0)" << std::endl;
+    std::cerr << "    -threads  The number of threads (default: one per core)" << std::endl;
+    std::cerr << "    -diff     Write the differences as a heat map" << std::endl;
+    std::cerr << "Exits with 0 if no pixel is over the tolerance, 1 if some are, and 2 on errors." << std::endl;
 }
 
 int main(int argc, char* argv[])
 {
+    int tolerance = 0;
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    const char* heatFile = NULL;
+    std::vector<char*> files;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            tolerance = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-diff") == 0 && i + 1 < argc)
+        {
+            heatFile = argv[++i];
+        }
+        else
+        {
+            files.push_back(argv[i]);
+        }
+    }
+
     //Make sure the inputs are provided.
-    if(argc != 3)
+    if(files.size() != 2 || tolerance < 0 || threads < 1)
     {
-        std::cerr << "Usage: " << argv[0] << " input1.png input2.png" << std::endl;
-        return 1;
+        usage(argv[0]);
+        return COMPARE_ERROR;
     }
 
     Image inputImage1, inputImage2;
-    bool read1 = read_png_file(argv[1], &inputImage1);
-    bool read2 = read_png_file(argv[2], &inputImage2);
+    bool read1 = read_png_file(files[0], &inputImage1);
+    bool read2 = read_png_file(files[1], &inputImage2);
 
     //Compare the images.
-    compare_images(&inputImage1, &inputImage2);
+    int result = COMPARE_ERROR;
+    if(read1 && read2)
+    {
+        result = compare_images(&inputImage1, &inputImage2, tolerance, threads, heatFile);
+    }
 
     if(read1) deleteImage(&inputImage1);
     if(read2) deleteImage(&inputImage2);
-    return 0;
+    return result;
 }
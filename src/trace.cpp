@@ -0,0 +1,237 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <mpi.h>
+
+#include "trace.h"
+
+typedef struct TraceEvent {
+	const char* name;
+	double start, end;
+	//Only used by tiles.
+	int rowStart, colStart, rows, cols;
+} TraceEvent;
+
+//The pixels of a row that were shaded one after another. Their costs are
+//consecutive in pixelCost, in the order the runs were recorded.
+typedef struct CostRun {
+	int row, col, count;
+} CostRun;
+
+//The trace of this rank.
+static bool enabled = false;
+static double origin = 0.0;
+static std::vector<TraceEvent> events;
+static std::vector<CostRun> costRuns;
+static std::vector<float> pixelCost;
+static long long shadedPixels = 0;
+
+double traceNow() {
+	return enabled ? MPI_Wtime() : 0.0;
+}
+
+static void record(const char* name, double start, int rowStart, int colStart, int rows, int cols) {
+	TraceEvent event;
+	event.name = name;
+	event.start = start;
+	event.end = MPI_Wtime();
+	event.rowStart = rowStart;
+	event.colStart = colStart;
+	event.rows = rows;
+	event.cols = cols;
+	events.push_back(event);
+}
+
+void traceEvent(const char* name, double start) {
+	if (enabled) {
+		record(name, start, 0, 0, 0, 0);
+	}
+}
+
+void traceTile(int rowStart, int colStart, int rows, int cols, double start) {
+	if (enabled) {
+		record("tile", start, rowStart, colStart, rows, cols);
+	}
+}
+
+long long shadedPixelCount() {
+	return shadedPixels;
+}
+
+void resetShadedPixelCount() {
+	shadedPixels = 0;
+}
+
+void shadeTracedPixel(float* color, int row, int column, ConfigData* data) {
+	++shadedPixels;
+	if (!enabled) {
+		shadePixel(color, row, column, data);
+		return;
+	}
+	double start = MPI_Wtime();
+	shadePixel(color, row, column, data);
+	pixelCost.push_back((MPI_Wtime() - start) * 1.0e9);
+	if (costRuns.empty() || costRuns.back().row != row || costRuns.back().col + costRuns.back().count != column) {
+		CostRun run = {row, column, 0};
+		costRuns.push_back(run);
+	}
+	++costRuns.back().count;
+}
+
+void traceStart(ConfigData* data) {
+	enabled = data -> trace;
+	if (!enabled) {
+		return;
+	}
+	events.clear();
+	costRuns.clear();
+	pixelCost.clear();
+	MPI_Barrier(MPI_COMM_WORLD);
+	origin = MPI_Wtime();
+}
+
+//Collects a string from every rank on rank 0, in rank order.
+static std::string gatherText(const ConfigData* data, const std::string& text) {
+	int length = text.size();
+	std::vector<int> lengths(data -> mpi_procs), offsets(data -> mpi_procs);
+	MPI_Gather(&length, 1, MPI_INT, &lengths[0], 1, MPI_INT, 0, MPI_COMM_WORLD);
+	int total = 0;
+	for (int i = 0; i < data -> mpi_procs; ++i) {
+		offsets[i] = total;
+		total += lengths[i];
+	}
+	std::string all(data -> mpi_rank == 0 ? total : 0, ' ');
+	MPI_Gatherv((void*)text.data(), length, MPI_CHAR, all.empty() ? NULL : &all[0], &lengths[0], &offsets[0], MPI_CHAR, 0, MPI_COMM_WORLD);
+	return all;
+}
+
+//Collects the elements of a vector from every rank on rank 0, in rank
+//order. The counts are in elements of type.
+template <typename T>
+static std::vector<T> gatherVector(const ConfigData* data, const std::vector<T>& values, MPI_Datatype type) {
+	int count = values.size();
+	std::vector<int> counts(data -> mpi_procs), offsets(data -> mpi_procs);
+	MPI_Gather(&count, 1, MPI_INT, &counts[0], 1, MPI_INT, 0, MPI_COMM_WORLD);
+	long long total = 0;
+	for (int i = 0; i < data -> mpi_procs; ++i) {
+		offsets[i] = total;
+		total += counts[i];
+	}
+	if (total > 2147483647LL) {
+		std::cerr << "ERROR: The trace is too large to gather." << std::endl;
+		MPI_Abort(MPI_COMM_WORLD, MPI_ERR_OTHER);
+	}
+	std::vector<T> all(data -> mpi_rank == 0 ? total : 0);
+	MPI_Gatherv(values.empty() ? NULL : (void*)&values[0], count, type, all.empty() ? NULL : &all[0],
+		&counts[0], &offsets[0], type, 0, MPI_COMM_WORLD);
+	return all;
+}
+
+static std::string baseName(const std::string& file) {
+	size_t dot = file.rfind('.');
+	return dot == std::string::npos ? file : file.substr(0, dot);
+}
+
+//Maps 0..1 to black, red, yellow, white.
+static void heat(float t, float* color) {
+	color[0] = t * 3.0f > 1.0f ? 1.0f : t * 3.0f;
+	color[1] = t * 3.0f - 1.0f;
+	color[2] = t * 3.0f - 2.0f;
+	color[1] = color[1] < 0.0f ? 0.0f : (color[1] > 1.0f ? 1.0f : color[1]);
+	color[2] = color[2] < 0.0f ? 0.0f : (color[2] > 1.0f ? 1.0f : color[2]);
+}
+
+void traceFinish(ConfigData* data, const std::string& file) {
+	if (!enabled) {
+		return;
+	}
+	enabled = false;
+
+	//Chrome trace events use microseconds; every rank gets its own track.
+	std::ostringstream json, tiles;
+	double busy = 0.0, communication = 0.0, waiting = 0.0;
+	for (size_t i = 0; i < events.size(); ++i) {
+		const TraceEvent& e = events[i];
+		double duration = e.end - e.start;
+		json << ",\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << data -> mpi_rank
+			<< ",\"ts\":" << (e.start - origin) * 1.0e6 << ",\"dur\":" << duration * 1.0e6;
+		if (e.rows > 0) {
+			json << ",\"args\":{\"row\":" << e.rowStart << ",\"col\":" << e.colStart
+				<< ",\"rows\":" << e.rows << ",\"cols\":" << e.cols << "}";
+			tiles << data -> mpi_rank << "," << e.rowStart << "," << e.colStart << "," << e.rows << "," << e.cols
+				<< "," << e.rows * e.cols << "," << (long long)(duration * 1.0e9) << "\n";
+			busy += duration;
+		}
+		else if (strcmp(e.name, "barrier") == 0 || strcmp(e.name, "reduce") == 0) {
+			waiting += duration;
+		}
+		else if (strcmp(e.name, "send") == 0 || strcmp(e.name, "recv") == 0 || strcmp(e.name, "fetch") == 0 || strcmp(e.name, "put") == 0 || strcmp(e.name, "gather") == 0) {
+			communication += duration;
+		}
+		json << "}";
+	}
+	std::ostringstream summary;
+	summary << "Rank " << data -> mpi_rank << ": tiles " << busy << " s, communication " << communication << " s, waiting " << waiting << " s\n";
+
+	std::string allEvents = gatherText(data, json.str());
+	std::string allTiles = gatherText(data, tiles.str());
+	std::string allSummaries = gatherText(data, summary.str());
+	//Only the pixels a rank shaded are sent, as runs of a row.
+	std::vector<int> runs;
+	for (size_t i = 0; i < costRuns.size(); ++i) {
+		runs.push_back(costRuns[i].row);
+		runs.push_back(costRuns[i].col);
+		runs.push_back(costRuns[i].count);
+	}
+	std::vector<int> allRuns = gatherVector(data, runs, MPI_INT);
+	std::vector<float> allCosts = gatherVector(data, pixelCost, MPI_FLOAT);
+	events.clear();
+	costRuns.clear();
+	pixelCost.clear();
+	if (data -> mpi_rank != 0) {
+		return;
+	}
+	int numPixels = data -> width * data -> height;
+	std::vector<float> cost(numPixels, 0.0f);
+	size_t next = 0;
+	for (size_t i = 0; i < allRuns.size(); i += 3) {
+		float* row = &cost[(size_t)allRuns[i] * data -> width + allRuns[i + 1]];
+		for (int j = 0; j < allRuns[i + 2]; ++j) {
+			row[j] += allCosts[next++];
+		}
+	}
+
+	std::string base = baseName(file);
+	std::ofstream traceFile((base + "_trace.json").c_str());
+	traceFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"raytrace_mpi\"}}"
+		<< allEvents << "\n]}\n";
+
+	std::ofstream tileFile((base + "_tiles.csv").c_str());
+	tileFile << "rank,row,col,rows,cols,primary_rays,ns\n" << allTiles;
+
+	FILE* costFile = fopen((base + "_cost.bin").c_str(), "wb");
+	if (costFile != NULL) {
+		fwrite(&data -> width, sizeof(int), 1, costFile);
+		fwrite(&data -> height, sizeof(int), 1, costFile);
+		fwrite(&cost[0], sizeof(float), numPixels, costFile);
+		fclose(costFile);
+	}
+
+	float maxCost = 0.0f;
+	for (int i = 0; i < numPixels; ++i) {
+		maxCost = cost[i] > maxCost ? cost[i] : maxCost;
+	}
+	float* heatMap = new float[3 * numPixels];
+	for (int i = 0; i < numPixels; ++i) {
+		heat(maxCost > 0.0f ? cost[i] / maxCost : 0.0f, &heatMap[3 * i]);
+	}
+	savePixels(base + "_cost.png", heatMap, data);
+	delete[] heatMap;
+
+	std::cout << allSummaries;
+	std::cout << "Maximum Pixel Cost: " << maxCost << " ns" << std::endl;
+	std::cout << "Trace saved to: " << base << "_trace.json" << std::endl;
+}
@@ -0,0 +1,401 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <mpi.h>
+
+#include "tune.h"
+#include "options.h"
+#include "frames.h"
+#include "master.h"
+#include "slave.h"
+#include "utils.h"
+#include "rma.h"
+
+//Calibration renders are never smaller than this on either side, and
+//every candidate keeps its fastest of a few renders to damp noise.
+static const int MIN_CALIBRATION_SIZE = 32;
+static const int CALIBRATION_REPEATS = 2;
+
+typedef struct TuneCandidate {
+	//Block height and width, or the cycle size in first.
+	int first, second;
+	double time;
+} TuneCandidate;
+
+static bool byTime(const TuneCandidate& a, const TuneCandidate& b) {
+	return a.time < b.time;
+}
+
+//Returns the value following option, or NULL if it was not given.
+static const char* findArgument(int argc, char* argv[], const char* option) {
+	const char* value = NULL;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], option) == 0) {
+			value = argv[i + 1];
+		}
+	}
+	return value;
+}
+
+static void removeArgument(int* argc, char* argv[], const char* option) {
+	int kept = 1;
+	for (int i = 1; i < *argc; ++i) {
+		if (strcmp(argv[i], option) == 0 && i + 1 < *argc) {
+			++i;
+			continue;
+		}
+		argv[kept++] = argv[i];
+	}
+	argv[kept] = NULL;
+	*argc = kept;
+}
+
+//64-bit FNV-1a.
+static unsigned long long hashBytes(unsigned long long hash, const std::string& bytes) {
+	for (size_t i = 0; i < bytes.size(); ++i) {
+		hash = (hash ^ (unsigned char)bytes[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool readFile(const std::string& path, std::string* contents) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in) {
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << in.rdbuf();
+	*contents = buffer.str();
+	return true;
+}
+
+//Hashes the scene file, every model it names and the material libraries
+//those name, so an edited mesh gets tuned again.
+static unsigned long long hashScene(const char* path) {
+	std::string xml;
+	readFile(path, &xml);
+	unsigned long long hash = hashBytes(14695981039346656037ULL, xml);
+	for (size_t start = xml.find("<Path>"); start != std::string::npos; start = xml.find("<Path>", start + 1)) {
+		size_t end = xml.find("</Path>", start);
+		std::string model, file = xml.substr(start + 6, end == std::string::npos ? 0 : end - start - 6);
+		if (end == std::string::npos || !readFile(file, &model)) {
+			continue;
+		}
+		hash = hashBytes(hash, model);
+		size_t slash = file.rfind('/');
+		std::string directory = slash == std::string::npos ? "" : file.substr(0, slash + 1);
+		std::istringstream lines(model);
+		std::string line, material;
+		while (std::getline(lines, line)) {
+			if (line.compare(0, 7, "mtllib ") != 0) {
+				continue;
+			}
+			std::string name = line.substr(7);
+			name.erase(name.find_last_not_of(" \t\r") + 1);
+			if (readFile(directory + name, &material)) {
+				hash = hashBytes(hash, material);
+			}
+		}
+	}
+	return hash;
+}
+
+//The scheduler options are part of the key: -rma and -hier change who
+//renders and how the image is collected, and -order which blocks go first.
+static std::string cacheKey(const ConfigData* data, unsigned long long hash, int width, int height, PartType mode) {
+	std::ostringstream key;
+	key << std::hex << hash << std::dec << " " << width << " " << height << " " << data -> mpi_procs << " " << mode
+		<< " " << data -> dynamicRMA << " " << data -> hierarchical << " " << data -> blockOrder;
+	return key.str();
+}
+
+//Rank 0 looks the key up; the newest entry wins.
+static bool readCache(const ConfigData* data, const std::string& key, int* first, int* second) {
+	int found[3] = {0, 0, 0};
+	if (data -> mpi_rank == 0) {
+		std::ifstream in(data -> tuneCache.c_str());
+		std::string line;
+		while (std::getline(in, line)) {
+			if (line.compare(0, key.size() + 1, key + " ") == 0) {
+				std::istringstream values(line.substr(key.size() + 1));
+				int a, b;
+				if (values >> a >> b) {
+					found[0] = 1;
+					found[1] = a;
+					found[2] = b;
+				}
+			}
+		}
+	}
+	MPI_Bcast(found, 3, MPI_INT, 0, MPI_COMM_WORLD);
+	*first = found[1];
+	*second = found[2];
+	return found[0] != 0;
+}
+
+static void writeCache(const ConfigData* data, const std::string& key, int first, int second) {
+	if (data -> mpi_rank != 0) {
+		return;
+	}
+	std::ofstream out(data -> tuneCache.c_str(), std::ios::app);
+	out << key << " " << first << " " << second << "\n";
+	if (!out) {
+		std::cerr << "WARNING: Could not write the tuning cache " << data -> tuneCache << std::endl;
+	}
+}
+
+static void addCandidate(std::vector<TuneCandidate>* candidates, int first, int second) {
+	TuneCandidate candidate;
+	candidate.first = first;
+	candidate.second = second;
+	candidate.time = 0.0;
+	candidates -> push_back(candidate);
+}
+
+//Block edges are powers of two with an aspect ratio of at most 4, plus
+//full rows. Cycle sizes are powers of two that still give every rank a
+//cycle.
+static std::vector<TuneCandidate> makeCandidates(PartType mode, int width, int height, int procs) {
+	std::vector<TuneCandidate> candidates;
+	if (mode == PART_MODE_DYNAMIC) {
+		for (int h = 2; h <= 128 && h <= height; h *= 2) {
+			for (int w = 2; w <= 128 && w <= width; w *= 2) {
+				if (w <= 4 * h && h <= 4 * w) {
+					addCandidate(&candidates, h, w);
+				}
+			}
+		}
+		for (int h = 1; h <= 8 && h <= height; h *= 2) {
+			addCandidate(&candidates, h, width);
+		}
+	}
+	else {
+		for (int cs = 1; cs * procs <= height; cs *= 2) {
+			addCandidate(&candidates, cs, 0);
+		}
+	}
+	return candidates;
+}
+
+static int scaleSize(int size, int from, int to) {
+	int scaled = (int)floor((double)size * to / from + 0.5);
+	return std::max(1, std::min(scaled, to));
+}
+
+//Renders the loaded scene once with a candidate and returns the time
+//measured on rank 0, or a negative time if the candidate does not fit.
+static double calibrate(ConfigData* scene, PartType mode, int first, int second) {
+	ConfigData job = *scene;
+	job.partitioningMode = mode;
+	if (mode == PART_MODE_DYNAMIC) {
+		job.dynamicBlockHeight = first;
+		job.dynamicBlockWidth = second;
+		//Every slave is handed a block before the master starts counting;
+		//with -rma, every rank claims its own.
+		int numBlocks = ceilFunc(job.width, second) * ceilFunc(job.height, first);
+		if (!job.dynamicRMA && numBlocks < job.mpi_procs - 1) {
+			return -1.0;
+		}
+	}
+	else {
+		job.cycleSize = first;
+	}
+
+	//The partitioning functions report their own times; keep them quiet.
+	std::streambuf* console = std::cout.rdbuf();
+	std::ostringstream discard;
+	std::cout.rdbuf(discard.rdbuf());
+	MPI_Barrier(MPI_COMM_WORLD);
+	double start = MPI_Wtime();
+	//The same scheduler as the render; under -rma rank 0 renders too.
+	if (mode == PART_MODE_DYNAMIC && job.dynamicRMA) {
+		float* pixels = job.mpi_rank == 0 ? new float[3 * job.width * job.height] : NULL;
+		dynamicRMAPartition(&job, pixels);
+		delete[] pixels;
+	}
+	else if (job.mpi_rank == 0) {
+		float* pixels = new float[3 * job.width * job.height];
+		if (mode == PART_MODE_DYNAMIC) {
+			masterDynamicPartition(&job, pixels);
+		}
+		else {
+			staticCyclesHorizontal(&job, pixels);
+		}
+		delete[] pixels;
+	}
+	else if (mode == PART_MODE_DYNAMIC) {
+		slaveDynamicPartition(&job);
+	}
+	else {
+		staticCyclesHorizontal(&job);
+	}
+	double time = MPI_Wtime() - start;
+	std::cout.rdbuf(console);
+	MPI_Bcast(&time, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	return time;
+}
+
+static bool loadCalibrationScene(ConfigData* scene, const ConfigData* data, const char* config, int width, int height) {
+	setDefaultOptions(scene);
+	scene -> mpi_rank = data -> mpi_rank;
+	scene -> mpi_procs = data -> mpi_procs;
+	//Blocks are tuned with the scheduler and in the order they will be
+	//handed out in.
+	scene -> dynamicRMA = data -> dynamicRMA;
+	scene -> hierarchical = data -> hierarchical;
+	scene -> blockOrder = data -> blockOrder;
+	scene -> costMap = data -> costMap;
+	scene -> costMapWidth = data -> costMapWidth;
+	scene -> costMapHeight = data -> costMapHeight;
+	std::ostringstream w, h;
+	w << width;
+	h << height;
+	FrameSet frames;
+	const char* args[] = {"raytrace_mpi", "-w", "", "-h", "", "-c", "", "-p", "none"};
+	frames.args.assign(args, args + 9);
+	frames.args[2] = w.str();
+	frames.args[4] = h.str();
+	frames.configArg = 6;
+	frames.args[frames.configArg] = config;
+	frames.config = config;
+	return initializeFrame(scene, &frames, -1);
+}
+
+static bool autotune(const ConfigData* data, PartType mode, const char* config, int width, int height, int* first, int* second) {
+	std::vector<TuneCandidate> alive = makeCandidates(mode, width, height, data -> mpi_procs);
+	if (alive.empty()) {
+		return true;
+	}
+	int rounds = 0;
+	while ((1 << rounds) < (int)alive.size()) {
+		++rounds;
+	}
+	double tuneStart = MPI_Wtime();
+	for (int round = 0; round < rounds; ++round) {
+		double scale = data -> tuneScale / (1 << (rounds - 1 - round));
+		int calibrationWidth = std::min(width, std::max(MIN_CALIBRATION_SIZE, (int)(width * scale)));
+		int calibrationHeight = std::min(height, std::max(MIN_CALIBRATION_SIZE, (int)(height * scale)));
+		ConfigData scene;
+		if (loadCalibrationScene(&scene, data, config, calibrationWidth, calibrationHeight)) {
+			return true;
+		}
+		for (size_t i = 0; i < alive.size(); ++i) {
+			int a = scaleSize(alive[i].first, height, calibrationHeight);
+			int b = mode == PART_MODE_DYNAMIC ? scaleSize(alive[i].second, width, calibrationWidth) : 0;
+			alive[i].time = HUGE_VAL;
+			for (int repeat = 0; repeat < CALIBRATION_REPEATS; ++repeat) {
+				double time = calibrate(&scene, mode, a, b);
+				if (time >= 0.0 && time < alive[i].time) {
+					alive[i].time = time;
+				}
+			}
+		}
+		shutdown(&scene);
+
+		std::stable_sort(alive.begin(), alive.end(), byTime);
+		if (data -> mpi_rank == 0) {
+			std::cout << "Autotune round " << round << ": " << calibrationWidth << " x " << calibrationHeight
+				<< ", " << alive.size() << " candidates, best " << alive[0].first;
+			if (mode == PART_MODE_DYNAMIC) {
+				std::cout << " x " << alive[0].second;
+			}
+			std::cout << " in " << alive[0].time << " seconds" << std::endl;
+		}
+		alive.resize((alive.size() + 1) / 2);
+	}
+	*first = alive[0].first;
+	*second = alive[0].second;
+	if (data -> mpi_rank == 0) {
+		std::cout << "Autotune Time: " << MPI_Wtime() - tuneStart << " seconds" << std::endl;
+	}
+	return false;
+}
+
+bool tuneArguments(ConfigData* data, int* argc, char** argv[]) {
+	const char* mode = findArgument(*argc, *argv, "-p");
+	PartType partitioningMode;
+	if (mode != NULL && strcmp(mode, "dynamic") == 0) {
+		partitioningMode = PART_MODE_DYNAMIC;
+	}
+	else if (mode != NULL && strcmp(mode, "static_cycles_horizontal") == 0) {
+		partitioningMode = PART_MODE_STATIC_CYCLES_HORIZONTAL;
+	}
+	else {
+		return false;
+	}
+	bool dynamic = partitioningMode == PART_MODE_DYNAMIC;
+	bool given = dynamic ? findArgument(*argc, *argv, "-bh") != NULL && findArgument(*argc, *argv, "-bw") != NULL
+		: findArgument(*argc, *argv, "-cs") != NULL;
+	if (given && !data -> autotune) {
+		return false;
+	}
+
+	//Leave anything that cannot be tuned for initialize() to report.
+	const char* config = findArgument(*argc, *argv, "-c");
+	const char* width = findArgument(*argc, *argv, "-w");
+	const char* height = findArgument(*argc, *argv, "-h");
+	if (config == NULL || width == NULL || height == NULL || access(config, R_OK) != 0 || atoi(width) <= 0 || atoi(height) <= 0) {
+		return false;
+	}
+	MPI_Comm_rank(MPI_COMM_WORLD, &data -> mpi_rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &data -> mpi_procs);
+	if (dynamic && data -> mpi_procs < 2) {
+		return false;
+	}
+
+	std::string key = cacheKey(data, hashScene(config), atoi(width), atoi(height), partitioningMode);
+	int first, second;
+	if (data -> autotune) {
+		if (autotune(data, partitioningMode, config, atoi(width), atoi(height), &first, &second)) {
+			std::cerr << "ERROR: Autotuning failed." << std::endl;
+			return true;
+		}
+		writeCache(data, key, first, second);
+	}
+	else if (!readCache(data, key, &first, &second)) {
+		return false;
+	}
+
+	//The strings and the argument array live until the program exits.
+	static std::vector<std::string> added;
+	static std::vector<char*> args;
+	std::ostringstream a, b;
+	a << first;
+	b << second;
+	removeArgument(argc, *argv, dynamic ? "-bh" : "-cs");
+	removeArgument(argc, *argv, "-bw");
+	if (dynamic) {
+		added.push_back("-bh");
+		added.push_back(a.str());
+		added.push_back("-bw");
+		added.push_back(b.str());
+	}
+	else {
+		added.push_back("-cs");
+		added.push_back(a.str());
+	}
+	args.assign(*argv, *argv + *argc);
+	for (size_t i = 0; i < added.size(); ++i) {
+		args.push_back(&added[i][0]);
+	}
+	args.push_back(NULL);
+	*argc = (int)args.size() - 1;
+	*argv = &args[0];
+
+	if (data -> mpi_rank == 0) {
+		std::cout << (data -> autotune ? "Tuned " : "Using cached ");
+		if (dynamic) {
+			std::cout << "block size: " << first << " x " << second << std::endl;
+		}
+		else {
+			std::cout << "cycle size: " << first << std::endl;
+		}
+	}
+	return false;
+}
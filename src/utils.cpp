@@ -1,4 +1,5 @@
 #include "utils.h"
+#include "order.h"
 #include <algorithm>
 
 int isPerfectSquare(int num) {
@@ -72,14 +73,16 @@ DynamicBlock::DynamicBlock(const ConfigData* data) {
 	blockWidth = data -> dynamicBlockWidth;
 	numBlocksWide = ceilFunc(data -> width, blockWidth);
 	numBlocksTall = ceilFunc(data -> height, blockHeight);
+	blockOrder(data, blockWidth, blockHeight, numBlocksWide, numBlocksTall, &order);
 	updateDynamicBlockData(data, data -> mpi_rank);
 }
 
 void DynamicBlock::updateDynamicBlockData(const ConfigData* data, int blockID) {
 	this -> blockID = blockID;
+	int block = blockID < (int)order.size() ? order[blockID] : blockID;
 	
-	xBlockID = blockID % numBlocksWide;
-	yBlockID = blockID / numBlocksWide;
+	xBlockID = block % numBlocksWide;
+	yBlockID = block / numBlocksWide;
 	
 	blockRowStart = yBlockID * blockHeight;
 	blockColStart = xBlockID * blockWidth;
@@ -93,7 +96,9 @@ void DynamicBlock::updateDynamicBlockData(const ConfigData* data, int blockID) {
 
 int DynamicBlock::getNumOfPixels() { return 3 * blockRowNum * blockColNum;}
 
-int DynamicBlock::getSize() {return getNumOfPixels() + DYNAMIC_PACKET_MAX;}
+//A packet holds any block: the one of the rank or of order[rank] that the
+//constructor picks can be a partial block at the edge, or past the image.
+int DynamicBlock::getSize() {return 3 * blockHeight * blockWidth + DYNAMIC_PACKET_MAX;}
 
 int DynamicBlock::getIndex(int row, int col) {
 	return DYNAMIC_PACKET_MAX + 3 * (row * blockColNum + col);